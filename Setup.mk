@@ -21,6 +21,12 @@ CFLAGS   += -O2
 LDFLAGS  += -s
 endif
 
+# extra compiler flags for the io_uring backend of the server
+ifeq ($(URING),1)
+OBJDIR   := $(OBJDIR).uring
+CPPFLAGS += -DXBUS_URING
+endif
+
 # extra compiler flags for address sanitizer
 ifeq ($(ASAN),1)
 OBJDIR   := $(OBJDIR).asan
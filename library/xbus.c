@@ -11,7 +11,8 @@
 #define _GNU_SOURCE
 #endif
 
-#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -19,7 +20,13 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 #include "xbus.h"
@@ -32,36 +39,519 @@
 // maximum packet size
 #define XBUS_MAX_SIZE   8192
 
+// minimum size of a payload passed in a memory file
+#define XBUS_MEMFD_SIZE 65536
+
+// environment variable with the capacity of a shared ring buffer for sent packets
+#define XBUS_RING_ENV   "XBUS_RING"
+
+// minimum and maximum capacity of a shared ring buffer
+#define XBUS_RING_MIN   32768
+#define XBUS_RING_MAX   16777216
+
+// maximum time of waiting for free space in a shared ring buffer in milliseconds
+#define XBUS_RING_WAIT  100
+
+// maximum number of requests waiting for replies (replies must fit into the queue of the message broker)
+#define XBUS_WINDOW     128
+
+// operation codes of binary packets
+#define OP_MESSAGE      0
+#define OP_PUBLISH      1
+#define OP_WRITE        2
+#define OP_READ         3
+#define OP_SUBSCRIBE    4
+#define OP_UNSUBSCRIBE  5
+#define OP_LIST         6
+#define OP_OPTION       7
+#define OP_HELLO        8
+#define OP_CONTINUE     9
+#define OP_RING         10
+#define OP_ALIAS        11
+#define OP_REPLY        12
+
+// flags of binary packets
+#define FLAG_MORE       0x0001
+#define FLAG_MEMFD      0x0002
+#define FLAG_ALIAS      0x0004
+#define FLAG_BULK       0x0010
+
+// **************************************************************************
+
+// header of a binary packet (followed by the topic, a null character and the payload)
+struct header {
+  uint8_t               marker;
+  uint8_t               opcode;
+  uint16_t              flags;
+  uint32_t              topic_size;
+  uint32_t              payload_size;
+};
+
+// buffer for a control message carrying descriptors
+union control {
+  struct cmsghdr        header;
+  char                  data[CMSG_SPACE(2 * sizeof(int))];
+};
+
+// numeric alias of a topic registered in the message broker
+struct alias {
+  unsigned int          id;
+  char                  *topic;
+};
+
+// message or reply received before it has been requested
+struct item {
+  struct item           *next_ptr;
+  unsigned long         id;
+  int                   more;
+  size_t                size;
+  char                  *topic;
+  char                  *payload;
+  char                  data[];
+};
+
+// shared ring buffer of packets sent by a client (a single producer and a single consumer)
+struct ring {
+  uint32_t              head;
+  uint32_t              sleeping;
+  uint8_t               reserved1[56];
+  uint32_t              tail;
+  uint32_t              waiting;
+  uint8_t               reserved2[56];
+  char                  data[];
+};
+
 // **************************************************************************
 
 // socket descriptor
 static int xbus_sk = -1;
 
+// shared ring buffer for sent packets
+static struct ring *xbus_ring = NULL;
+static size_t xbus_ring_size = 0;
+
+// descriptor for notification of the message broker about packets in the ring buffer
+static int xbus_ring_fd = -1;
+
+// registered topic aliases sorted by their identifiers
+static struct alias *xbus_aliases = NULL;
+static size_t xbus_alias_count = 0;
+
+// time to live of stored messages set in the message broker in seconds
+static unsigned long xbus_ttl = 0;
+
+// correlation identifier of the last request and the number of requests waiting for replies
+static unsigned long xbus_request_id = 0;
+static size_t xbus_request_count = 0;
+
+// messages received while waiting for replies
+static struct item *xbus_first_message = NULL;
+static struct item *xbus_last_message = NULL;
+
+// replies received before they have been requested
+static struct item *xbus_first_reply = NULL;
+static struct item *xbus_last_reply = NULL;
+
+// message or reply returned by the last call of a receiving function
+static struct item *xbus_returned = NULL;
+
+// list of stored messages joined from parts of the reply
+static char *xbus_listing = NULL;
+static size_t xbus_listing_size = 0;
+
+// **************************************************************************
+// wait until the ring buffer has the required free space (async-signal-safe)
+static int xbus_ring_wait(uint32_t tail, uint32_t space)
+{
+  struct timespec       timeout;
+  struct pollfd         pfd;
+  uint32_t              head;
+
+  // wait until the message broker releases enough records
+  while (xbus_ring_size - (tail - (head = __atomic_load_n(&xbus_ring->head, __ATOMIC_ACQUIRE))) < space) {
+
+    // ask the message broker for a wake-up and check the free space once again
+    __atomic_store_n(&xbus_ring->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&xbus_ring->head, __ATOMIC_SEQ_CST) != head) {
+      continue;
+    }
+
+    // sleep until the position of the message broker changes
+    timeout.tv_sec  = 0;
+    timeout.tv_nsec = XBUS_RING_WAIT * 1000000L;
+    if (syscall(SYS_futex, &xbus_ring->head, FUTEX_WAIT, head, &timeout, NULL, 0) == 0 || errno != ETIMEDOUT) {
+      continue;
+    }
+
+    // stop waiting if the message broker has closed the connection
+    pfd.fd     = xbus_sk;
+    pfd.events = 0;
+    if (poll(&pfd, 1, 0) != 0) {
+      return -1;
+    }
+  }
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// append the packet to the ring buffer and notify the message broker if it sleeps (async-signal-safe)
+static int xbus_ring_send(const struct msghdr *msg)
+{
+  uint64_t              value;
+  uint32_t              length;
+  uint32_t              record;
+  uint32_t              offset;
+  uint32_t              tail;
+  size_t                i;
+
+  // get length of the packet and size of its record
+  length = 0;
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    length += msg->msg_iov[i].iov_len;
+  }
+  record = (sizeof(length) + length + 3) & ~3U;
+
+  // wait for free space (unused space at the end of the ring buffer is skipped)
+  tail   = xbus_ring->tail;
+  offset = tail & (xbus_ring_size - 1);
+  if (xbus_ring_wait(tail, offset + record > xbus_ring_size ? xbus_ring_size - offset + record : record) != 0) {
+    return -1;
+  }
+  if (offset + record > xbus_ring_size) {
+    memset(xbus_ring->data + offset, 0, sizeof(length));
+    tail  += xbus_ring_size - offset;
+    offset = 0;
+  }
+
+  // copy the packet to the ring buffer
+  memcpy(xbus_ring->data + offset, &length, sizeof(length));
+  offset += sizeof(length);
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    memcpy(xbus_ring->data + offset, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+    offset += msg->msg_iov[i].iov_len;
+  }
+
+  // publish the record
+  __atomic_store_n(&xbus_ring->tail, tail + record, __ATOMIC_SEQ_CST);
+
+  // notify the message broker only if it has processed all previous records
+  if (__atomic_load_n(&xbus_ring->sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&xbus_ring->sleeping, 0, __ATOMIC_SEQ_CST)) {
+    value = 1;
+    if (write(xbus_ring_fd, &value, sizeof(value)) != sizeof(value)) {
+      return -1;
+    }
+  }
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// send the packet through the ring buffer if it is attached, otherwise over the socket (async-signal-safe)
+static int xbus_transmit(const struct msghdr *msg)
+{
+  // append the packet to the ring buffer
+  if (xbus_ring) {
+    return xbus_ring_send(msg);
+  }
+
+  // send the packet over the socket
+  return sendmsg(xbus_sk, msg, MSG_EOR | MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+// **************************************************************************
+// send the message with the payload in a sealed memory file (async-signal-safe)
+static int xbus_send_memfd(int opcode, const char *topic, const void *payload, size_t size)
+{
+  struct header         header;
+  union control         control;
+  struct cmsghdr        *cmsg;
+  struct iovec          iov[3];
+  struct msghdr         msg;
+  const char            *ptr;
+  ssize_t               count;
+  size_t                offset;
+  int                   result;
+  int                   fd;
+
+  // create a memory file with the payload terminated by a null character
+  if ((fd = memfd_create("xbus", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0) {
+    return 1;
+  }
+  if (ftruncate(fd, size + 1) != 0) {
+    close(fd);
+    return 1;
+  }
+  ptr = (const char *)payload;
+  for (offset = 0; offset < size; offset += count) {
+    if ((count = pwrite(fd, ptr + offset, size - offset, offset)) <= 0) {
+      close(fd);
+      return 1;
+    }
+  }
+
+  // seal the memory file so that the recipients can map it safely
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return 1;
+  }
+
+  // prepare the header
+  memset(&header, 0, sizeof(header));
+  header.opcode       = opcode;
+  header.flags        = FLAG_MEMFD;
+  header.topic_size   = strlen(topic);
+  header.payload_size = size;
+
+  // assemble the packet from the header, the topic and a null character
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = (void *)topic;
+  iov[1].iov_len  = header.topic_size;
+  iov[2].iov_base = "";
+  iov[2].iov_len  = 1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = 3;
+
+  // attach the descriptor of the memory file
+  msg.msg_control    = control.data;
+  msg.msg_controllen = sizeof(control.data);
+  cmsg             = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  // send the packet to the message broker
+  result = sendmsg(xbus_sk, &msg, MSG_EOR | MSG_NOSIGNAL) < 0 ? -1 : 0;
+
+  // close the memory file (the message broker holds its own descriptor)
+  close(fd);
+
+  // return the result
+  return result;
+}
+
+// **************************************************************************
+// send the binary packet to the message broker (async-signal-safe)
+static int xbus_send_packet(int opcode, const char *topic, const void *payload, size_t size)
+{
+  struct header         header;
+  struct iovec          iov[4];
+  struct msghdr         msg;
+  const char            *ptr;
+  size_t                topic_size;
+  size_t                part_size;
+  int                   result;
+
+  // pass a large message payload in a memory file if possible (descriptors cannot be passed through the ring buffer)
+  if (size >= XBUS_MEMFD_SIZE && (opcode == OP_PUBLISH || opcode == OP_WRITE) && !xbus_ring) {
+    if ((result = xbus_send_memfd(opcode, topic, payload, size)) <= 0) {
+      return result;
+    }
+  }
+
+  // get length of the topic
+  topic_size = strlen(topic);
+
+  // prepare the header (the packet HELLO announces that memory files can be received)
+  memset(&header, 0, sizeof(header));
+  header.opcode       = opcode;
+  header.flags        = opcode == OP_HELLO ? FLAG_MEMFD : 0;
+  header.topic_size   = topic_size;
+  header.payload_size = size;
+
+  // a payload which does not fit into one packet is split into several parts
+  part_size = size;
+  if (sizeof(header) + topic_size + size + 1 >= XBUS_MAX_SIZE) {
+    part_size = topic_size + sizeof(header) + 2 < XBUS_MAX_SIZE ? XBUS_MAX_SIZE - sizeof(header) - topic_size - 2 : 0;
+    header.flags = FLAG_MORE;
+  }
+
+  // assemble the packet from the header, the topic, a null character and the payload
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = (void *)topic;
+  iov[1].iov_len  = topic_size;
+  iov[2].iov_base = "";
+  iov[2].iov_len  = 1;
+  iov[3].iov_base = (void *)payload;
+  iov[3].iov_len  = part_size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = 4;
+
+  // send the packet to the message broker
+  if (xbus_transmit(&msg) != 0) {
+    return -1;
+  }
+
+  // send remaining parts of the payload as continuation packets
+  ptr = (const char *)payload + part_size;
+  size -= part_size;
+  while (header.flags & FLAG_MORE) {
+    part_size = size;
+    header.opcode       = OP_CONTINUE;
+    header.flags        = 0;
+    header.topic_size   = 0;
+    if (sizeof(header) + size + 1 >= XBUS_MAX_SIZE) {
+      part_size    = XBUS_MAX_SIZE - sizeof(header) - 2;
+      header.flags = FLAG_MORE;
+    }
+    header.payload_size = part_size;
+    iov[1].iov_len  = 0;
+    iov[3].iov_base = (void *)ptr;
+    iov[3].iov_len  = part_size;
+    if (xbus_transmit(&msg) != 0) {
+      return -1;
+    }
+    ptr  += part_size;
+    size -= part_size;
+  }
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// unmap the ring buffer and close its notification descriptor
+static void xbus_close_ring(void)
+{
+  // unmap the ring buffer
+  munmap(xbus_ring, sizeof(*xbus_ring) + xbus_ring_size);
+  xbus_ring      = NULL;
+  xbus_ring_size = 0;
+
+  // close the notification descriptor
+  close(xbus_ring_fd);
+  xbus_ring_fd = -1;
+}
+
+// **************************************************************************
+// wait for the binary packet confirming the request sent to the message broker and return its size
+static ssize_t xbus_wait_confirmation(int opcode, char *buffer, size_t size)
+{
+  struct header         header;
+  ssize_t               count;
+
+  // receive packets until the confirmation arrives (a connection does not receive other packets before it)
+  while (1) {
+    if ((count = recv(xbus_sk, buffer, size - 1, MSG_WAITALL | MSG_NOSIGNAL)) <= 0) {
+      syslog(LOG_CRIT, "xbus: connection terminated");
+      exit(EXIT_FAILURE);
+    }
+    buffer[count] = '\0';
+    if ((size_t)count >= sizeof(header) && !buffer[0]) {
+      memcpy(&header, buffer, sizeof(header));
+      if (header.opcode == opcode) {
+        return count;
+      }
+    }
+  }
+}
+
 // **************************************************************************
-// concatenate multiple strings (async-signal-safe)
-static void concat(char *dst, size_t size, ...)
+// pass a shared ring buffer for sent packets to the message broker if it is requested by the environment
+static void xbus_open_ring(void)
 {
-  va_list               ap;
-  const char            *src;
+  char                  buffer[XBUS_MAX_SIZE];
+  struct header         header;
+  union control         control;
+  struct cmsghdr        *cmsg;
+  struct iovec          iov[3];
+  struct msghdr         msg;
+  const char            *env;
+  unsigned long         requested;
+  ssize_t               count;
+  size_t                size;
+  int                   fds[2];
+
+  // get the requested capacity of the ring buffer
+  if (!(env = getenv(XBUS_RING_ENV)) || !(requested = strtoul(env, NULL, 0))) {
+    return;
+  }
 
-  // copy source strings to the target string
-  va_start(ap, size);
-  while ((src = va_arg(ap, const char *))) {
-    while (*src && size > 1) {
-      *dst++ = *src++;
-      size--;
+  // round the capacity up to a power of two within limits
+  for (size = XBUS_RING_MIN; size < requested && size < XBUS_RING_MAX; size <<= 1)
+    ;
+
+  // create the notification descriptor
+  if ((fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+    syslog(LOG_WARNING, "xbus: create eventfd error: %s", strerror(errno));
+    return;
+  }
+
+  // create the ring buffer in a memory file which cannot be shrunk
+  fds[0] = memfd_create("xbus-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fds[0] < 0 || ftruncate(fds[0], sizeof(*xbus_ring) + size) != 0 ||
+      fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0 ||
+      (xbus_ring = (struct ring *)mmap(NULL, sizeof(*xbus_ring) + size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0)) == MAP_FAILED) {
+    syslog(LOG_WARNING, "xbus: create ring buffer error: %s", strerror(errno));
+    xbus_ring = NULL;
+    if (fds[0] >= 0) {
+      close(fds[0]);
     }
+    close(fds[1]);
+    return;
   }
-  va_end(ap);
+  xbus_ring_size = size;
+  xbus_ring_fd   = fds[1];
+
+  // the message broker is sleeping until it is notified about the first packet
+  xbus_ring->sleeping = 1;
 
-  // terminate the target string
-  *dst = '\0';
+  // prepare the header
+  memset(&header, 0, sizeof(header));
+  header.opcode     = OP_RING;
+  header.topic_size = 4;
+
+  // assemble the packet from the header, the topic and a null character
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = "xbus";
+  iov[1].iov_len  = 4;
+  iov[2].iov_base = "";
+  iov[2].iov_len  = 1;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = 3;
+
+  // attach the descriptors of the ring buffer and the notification
+  msg.msg_control    = control.data;
+  msg.msg_controllen = sizeof(control.data);
+  cmsg             = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  // send the packet to the message broker
+  count = sendmsg(xbus_sk, &msg, MSG_EOR | MSG_NOSIGNAL);
+  close(fds[0]);
+  if (count < 0) {
+    syslog(LOG_CRIT, "xbus: connection terminated");
+    exit(EXIT_FAILURE);
+  }
+
+  // wait for the confirmation
+  count = xbus_wait_confirmation(OP_RING, buffer, sizeof(buffer));
+  memcpy(&header, buffer, sizeof(header));
+
+  // use the socket if the message broker has rejected the ring buffer
+  if ((size_t)count <= sizeof(header) + header.topic_size + 1 || strcmp(buffer + sizeof(header) + header.topic_size + 1, "accepted")) {
+    syslog(LOG_WARNING, "xbus: ring buffer rejected");
+    xbus_close_ring();
+  }
 }
 
 // **************************************************************************
 // connect to the message broker
 void xbus_connect(void)
 {
+  char                  buffer[XBUS_MAX_SIZE];
   struct sockaddr_un    addr;
 
   // return if the connection is already established
@@ -86,6 +576,31 @@ void xbus_connect(void)
 
   // enable automatic socket close during successful exec
   fcntl(xbus_sk, F_SETFD, FD_CLOEXEC);
+
+  // switch the connection to the binary protocol
+  if (xbus_send_packet(OP_HELLO, "xbus", "", 0) != 0) {
+    syslog(LOG_CRIT, "xbus: connection terminated");
+    exit(EXIT_FAILURE);
+  }
+
+  // wait for the confirmation, so that it is not taken for a pending message
+  xbus_wait_confirmation(OP_HELLO, buffer, sizeof(buffer));
+
+  // send following packets through a shared ring buffer if it is requested
+  xbus_open_ring();
+}
+
+// **************************************************************************
+// free the list of received messages or replies
+static void xbus_free_items(struct item *item_ptr)
+{
+  struct item           *next_ptr;
+
+  // traverse the list
+  for (; item_ptr; item_ptr = next_ptr) {
+    next_ptr = item_ptr->next_ptr;
+    free(item_ptr);
+  }
 }
 
 // **************************************************************************
@@ -109,24 +624,50 @@ void xbus_disconnect(void)
   // close the socket
   close(xbus_sk);
 
+  // destroy the ring buffer
+  if (xbus_ring) {
+    xbus_close_ring();
+  }
+
+  // forget registered aliases (they are valid only for the connection)
+  while (xbus_alias_count) {
+    free(xbus_aliases[--xbus_alias_count].topic);
+  }
+  free(xbus_aliases);
+  xbus_aliases = NULL;
+
+  // forget the time to live of stored messages
+  xbus_ttl = 0;
+
+  // forget received messages and replies
+  xbus_free_items(xbus_first_message);
+  xbus_free_items(xbus_first_reply);
+  xbus_free_items(xbus_returned);
+  xbus_first_message = NULL;
+  xbus_last_message  = NULL;
+  xbus_first_reply   = NULL;
+  xbus_last_reply    = NULL;
+  xbus_returned      = NULL;
+  xbus_request_count = 0;
+
+  // forget the last list of stored messages
+  free(xbus_listing);
+  xbus_listing      = NULL;
+  xbus_listing_size = 0;
+
   // invalidate the socket descriptor
   xbus_sk = -1;
 }
 
 // **************************************************************************
 // send the packet to the message broker
-static void xbus_send(const char *command, const char *topic, const char *payload)
+static void xbus_send(int opcode, const char *topic, const void *payload, size_t size)
 {
-  char                  buffer[XBUS_MAX_SIZE];
-
   // connect to the message broker
   xbus_connect();
 
-  // create the packet content
-  concat(buffer, sizeof(buffer), command, " ", topic, "\n", payload, NULL);
-
   // send the packet to the message broker
-  if (send(xbus_sk, buffer, strlen(buffer) + 1, MSG_EOR | MSG_NOSIGNAL) < 0) {
+  if (xbus_send_packet(opcode, topic, payload, size) != 0) {
     syslog(LOG_CRIT, "xbus: connection terminated");
     exit(EXIT_FAILURE);
   }
@@ -137,7 +678,26 @@ static void xbus_send(const char *command, const char *topic, const char *payloa
 void xbus_subscribe(const char *topic)
 {
   // send the packet SUBSCRIBE
-  xbus_send("SUBSCRIBE", topic, "");
+  xbus_send(OP_SUBSCRIBE, topic, "", 0);
+}
+
+// **************************************************************************
+// subscribe to the particular topic with options of the subscription
+void xbus_subscribe_options(const char *topic, const char *options)
+{
+  // send the packet SUBSCRIBE with the options
+  xbus_send(OP_SUBSCRIBE, topic, options, strlen(options));
+}
+
+// **************************************************************************
+// subscribe to the particular topic and receive only stored messages changed after the version of the store
+void xbus_subscribe_since(const char *topic, unsigned long long version)
+{
+  char                  options[32];
+
+  // send the packet SUBSCRIBE with the version
+  snprintf(options, sizeof(options), "since=%llu", version);
+  xbus_subscribe_options(topic, options);
 }
 
 // **************************************************************************
@@ -145,7 +705,7 @@ void xbus_subscribe(const char *topic)
 void xbus_unsubscribe(const char *topic)
 {
   // send the packet UNSUBSCRIBE
-  xbus_send("UNSUBSCRIBE", topic, "");
+  xbus_send(OP_UNSUBSCRIBE, topic, "", 0);
 }
 
 // **************************************************************************
@@ -153,70 +713,773 @@ void xbus_unsubscribe(const char *topic)
 void xbus_publish(const char *topic, const char *payload)
 {
   // send the packet PUBLISH
-  xbus_send("PUBLISH", topic, payload);
+  xbus_send(OP_PUBLISH, topic, payload, strlen(payload));
+}
+
+// **************************************************************************
+// set the time to live of messages stored by the following writes
+static void xbus_set_ttl(unsigned long ttl)
+{
+  char                  value[32];
+
+  // send the packet OPTION only if the time to live differs
+  if (xbus_ttl != ttl) {
+    snprintf(value, sizeof(value), "%lu", ttl);
+    xbus_send(OP_OPTION, "write-ttl", value, strlen(value));
+    xbus_ttl = ttl;
+  }
 }
 
 // **************************************************************************
 // publish and store the message
 void xbus_write(const char *topic, const char *payload)
 {
+  // store the message forever
+  xbus_set_ttl(0);
+
   // send the packet WRITE
-  xbus_send("WRITE", topic, payload);
+  xbus_send(OP_WRITE, topic, payload, strlen(payload));
 }
 
 // **************************************************************************
-// read a stored message
-char *xbus_read(const char *topic)
+// publish the binary message
+void xbus_publish_binary(const char *topic, const void *payload, size_t size)
 {
-  // send the packet READ
-  xbus_send("READ", topic, "");
+  // send the packet PUBLISH
+  xbus_send(OP_PUBLISH, topic, payload, size);
+}
 
-  // return the received response
-  return xbus_receive(NULL);
+// **************************************************************************
+// publish and store the binary message
+void xbus_write_binary(const char *topic, const void *payload, size_t size)
+{
+  // store the message forever
+  xbus_set_ttl(0);
+
+  // send the packet WRITE
+  xbus_send(OP_WRITE, topic, payload, size);
 }
 
 // **************************************************************************
-// get the list of stored messages
-char *xbus_list(void)
+// publish and store the binary message which expires after the given number of seconds
+void xbus_write_ttl(const char *topic, const void *payload, size_t size, unsigned long ttl)
 {
-  // send the packet LIST
-  xbus_send("LIST", "*", "");
+  // set the time to live of the message
+  xbus_set_ttl(ttl);
 
-  // return the received response
-  return xbus_receive(NULL);
+  // send the packet WRITE
+  xbus_send(OP_WRITE, topic, payload, size);
 }
 
 // **************************************************************************
-// receive a message
-char *xbus_receive(char **topic)
+// find the position of the alias in the sorted array of registered aliases
+static size_t xbus_find_alias(unsigned int id)
+{
+  size_t                low;
+  size_t                high;
+  size_t                mid;
+
+  // use binary search
+  low  = 0;
+  high = xbus_alias_count;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (xbus_aliases[mid].id < id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // return the index of the alias or the position where it should be inserted
+  return low;
+}
+
+// **************************************************************************
+// find the topic of the registered alias
+static char *xbus_alias_topic(unsigned int id)
+{
+  size_t                i;
+
+  // find the alias in the array
+  i = xbus_find_alias(id);
+
+  // return the topic
+  return i < xbus_alias_count && xbus_aliases[i].id == id ? xbus_aliases[i].topic : NULL;
+}
+
+// **************************************************************************
+// send the message by the alias of its topic
+static void xbus_send_alias(int opcode, unsigned int id, const void *payload, size_t size)
+{
+  struct header         header;
+  struct iovec          iov[3];
+  struct msghdr         msg;
+  const char            *topic;
+
+  // connect to the message broker
+  xbus_connect();
+
+  // find the topic of the alias
+  if (!(topic = xbus_alias_topic(id))) {
+    syslog(LOG_WARNING, "xbus: unknown alias %u", id);
+    return;
+  }
+
+  // send the message with the topic if it does not fit into one packet
+  if (sizeof(header) + size + 1 >= XBUS_MAX_SIZE) {
+    xbus_send(opcode, topic, payload, size);
+    return;
+  }
+
+  // prepare the header (the alias takes the place of the topic size)
+  memset(&header, 0, sizeof(header));
+  header.opcode       = opcode;
+  header.flags        = FLAG_ALIAS;
+  header.topic_size   = id;
+  header.payload_size = size;
+
+  // assemble the packet from the header, a null character and the payload
+  iov[0].iov_base = &header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = "";
+  iov[1].iov_len  = 1;
+  iov[2].iov_base = (void *)payload;
+  iov[2].iov_len  = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = 3;
+
+  // send the packet to the message broker
+  if (xbus_transmit(&msg) != 0) {
+    syslog(LOG_CRIT, "xbus: connection terminated");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// **************************************************************************
+// receive a packet and the descriptor passed along with it
+static ssize_t xbus_receive_packet(char *buffer, size_t size, int *fd)
+{
+  union control         control;
+  struct cmsghdr        *cmsg;
+  struct iovec          iov;
+  struct msghdr         msg;
+  ssize_t               count;
+
+  // prepare the buffers
+  iov.iov_base = buffer;
+  iov.iov_len  = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.data;
+  msg.msg_controllen = sizeof(control.data);
+
+  // receive the packet
+  *fd = -1;
+  if ((count = recvmsg(xbus_sk, &msg, MSG_WAITALL | MSG_NOSIGNAL | MSG_CMSG_CLOEXEC)) <= 0) {
+    return count;
+  }
+
+  // get the descriptor
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+
+  // return the size of the packet
+  return count;
+}
+
+// **************************************************************************
+// map the memory file with the payload of a message
+static char *xbus_map_payload(int fd, size_t size)
+{
+  struct stat           st;
+  char                  *payload;
+
+  // the memory file contains the payload terminated by a null character
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != size + 1) {
+    return NULL;
+  }
+
+  // map the memory file
+  if ((payload = (char *)mmap(NULL, size + 1, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    return NULL;
+  }
+
+  // check the terminating null character
+  if (payload[size]) {
+    munmap(payload, size + 1);
+    return NULL;
+  }
+
+  // return a pointer to the mapped payload
+  return payload;
+}
+
+// **************************************************************************
+// receive a message or a reply to a request (the reply has a nonzero correlation identifier and it is followed
+// by more replies to the same request if it is a part of a bulk read)
+static void *xbus_receive_next(char **topic, size_t *size, unsigned long *id, int *more)
 {
   static char           buffer[XBUS_MAX_SIZE];
+  static char           *message = NULL;
+  static char           *mapping = NULL;
+  static size_t         mapping_size = 0;
+  struct header         header;
+  char                  *alias;
+  char                  *name;
   char                  *ptr;
-  ssize_t               size;
+  size_t                length;
+  ssize_t               count;
+  int                   fd;
 
   // connect to the message broker
   xbus_connect();
 
-  // receive a packet from the message broker
-  if ((size = recv(xbus_sk, buffer, sizeof(buffer), MSG_WAITALL | MSG_NOSIGNAL)) <= 0) {
-    syslog(LOG_CRIT, "xbus: connection terminated");
+  // free memory of the previously received large message
+  if (message) {
+    free(message);
+    message = NULL;
+  }
+
+  // unmap the payload of the previously received message
+  if (mapping) {
+    munmap(mapping, mapping_size);
+    mapping = NULL;
+  }
+
+  // receive packets until a message or a reply arrives
+  while (1) {
+
+    // receive a packet from the message broker
+    if ((count = xbus_receive_packet(buffer, sizeof(buffer) - 1, &fd)) <= 0) {
+      syslog(LOG_CRIT, "xbus: connection terminated");
+      exit(EXIT_FAILURE);
+    }
+    buffer[count] = '\0';
+    alias = NULL;
+
+    // map the payload passed in a memory file (other packets with a descriptor are skipped)
+    if (fd >= 0) {
+      if ((size_t)count <= sizeof(header) || buffer[0]) {
+        close(fd);
+        continue;
+      }
+      memcpy(&header, buffer, sizeof(header));
+      if (header.opcode == OP_MESSAGE && (header.flags & FLAG_MEMFD) &&
+          (size_t)count == sizeof(header) + header.topic_size + 1) {
+        mapping = xbus_map_payload(fd, header.payload_size);
+      }
+      close(fd);
+      if (!mapping) {
+        continue;
+      }
+      mapping_size = header.payload_size + 1;
+      memmove(buffer, buffer + sizeof(header), header.topic_size + 1);
+      ptr = mapping;
+      break;
+    }
+
+    // split the text packet at the first newline character
+    if (buffer[0]) {
+      ptr = strchrnul(buffer, '\n');
+      if (*ptr) {
+        *ptr++ = '\0';
+      }
+      header.opcode       = OP_MESSAGE;
+      header.flags        = 0;
+      header.payload_size = strlen(ptr);
+      break;
+    }
+
+    // skip packets which are neither binary messages nor replies
+    if ((size_t)count < sizeof(header)) {
+      continue;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    length = count - sizeof(header);
+    if (header.opcode != OP_MESSAGE && header.opcode != OP_REPLY) {
+      continue;
+    }
+
+    // a message sent by the alias of its topic contains only a null character instead of the topic
+    if (header.flags & FLAG_ALIAS) {
+      if (!(alias = xbus_alias_topic(header.topic_size))) {
+        continue;
+      }
+      header.topic_size = 0;
+    }
+    if (length <= header.topic_size) {
+      continue;
+    }
+
+    // split the binary message according to its header
+    if (!(header.flags & FLAG_MORE)) {
+      if (length == header.topic_size + header.payload_size + 1) {
+        memmove(buffer, buffer + sizeof(header), length + 1);
+        ptr = buffer + header.topic_size + 1;
+        break;
+      }
+      continue;
+    }
+
+    // assemble a large message from its parts
+    if (!(message = (char *)malloc(header.topic_size + header.payload_size + 2))) {
+      syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    memcpy(message, buffer + sizeof(header), length);
+    while (length < header.topic_size + header.payload_size + 1) {
+      if ((count = recv(xbus_sk, buffer, sizeof(buffer) - 1, MSG_WAITALL | MSG_NOSIGNAL)) <= 0) {
+        syslog(LOG_CRIT, "xbus: connection terminated");
+        exit(EXIT_FAILURE);
+      }
+      if ((size_t)count <= sizeof(header) + 1 || buffer[0] || buffer[1] != OP_CONTINUE ||
+          length + count - sizeof(header) - 1 > header.topic_size + header.payload_size + 1) {
+        break;
+      }
+      memcpy(message + length, buffer + sizeof(header) + 1, count - sizeof(header) - 1);
+      length += count - sizeof(header) - 1;
+    }
+    if (length == header.topic_size + header.payload_size + 1) {
+      message[length] = '\0';
+      memcpy(buffer, message, header.topic_size + 1);
+      ptr = message + header.topic_size + 1;
+      break;
+    }
+    free(message);
+    message = NULL;
+  }
+
+  // the topic of a reply is preceded by the correlation identifier of the request and a space
+  name  = alias ? alias : buffer;
+  *id   = 0;
+  *more = 0;
+  if (header.opcode == OP_REPLY) {
+    *id   = strtoul(buffer, &name, 10);
+    *more = (header.flags & FLAG_BULK) != 0;
+    name += *name == ' ';
+    if (!*more && xbus_request_count) {
+      xbus_request_count--;
+    }
+  }
+
+  // return the topic and the size of the payload
+  *topic = name;
+  *size  = header.payload_size;
+
+  // return the payload
+  return ptr;
+}
+
+// **************************************************************************
+// keep the received message or reply until it is requested
+static void xbus_keep_item(unsigned long id, int more, const char *topic, const void *payload, size_t size)
+{
+  struct item           *item_ptr;
+  size_t                length;
+
+  // copy the topic and the payload terminated by null characters
+  length = strlen(topic);
+  if (!(item_ptr = (struct item *)malloc(sizeof(*item_ptr) + length + size + 2))) {
+    syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  item_ptr->next_ptr = NULL;
+  item_ptr->id       = id;
+  item_ptr->more     = more;
+  item_ptr->size     = size;
+  item_ptr->topic    = item_ptr->data;
+  item_ptr->payload  = item_ptr->data + length + 1;
+  memcpy(item_ptr->topic, topic, length + 1);
+  memcpy(item_ptr->payload, payload, size);
+  item_ptr->payload[size] = '\0';
+
+  // append the reply to the queue of replies
+  if (id) {
+    if (xbus_last_reply) {
+      xbus_last_reply->next_ptr = item_ptr;
+    } else {
+      xbus_first_reply = item_ptr;
+    }
+    xbus_last_reply = item_ptr;
+    return;
+  }
+
+  // append the message to the queue of messages
+  if (xbus_last_message) {
+    xbus_last_message->next_ptr = item_ptr;
+  } else {
+    xbus_first_message = item_ptr;
+  }
+  xbus_last_message = item_ptr;
+}
+
+// **************************************************************************
+// send the request with a new correlation identifier
+static unsigned long xbus_send_request(int opcode, const char *topic, const char *extra)
+{
+  char                  *options;
+  unsigned long         id;
+  char                  *name;
+  void                  *payload;
+  size_t                size;
+  int                   more;
+
+  // connect to the message broker
+  xbus_connect();
+
+  // keep received packets until the number of requests waiting for replies falls below the limit
+  while (xbus_request_count >= XBUS_WINDOW) {
+    payload = xbus_receive_next(&name, &size, &id, &more);
+    xbus_keep_item(id, more, name, payload, size);
+  }
+
+  // get a new nonzero identifier
+  if (!++xbus_request_id) {
+    xbus_request_id++;
+  }
+
+  // send the packet with the identifier and extra options
+  if (!(options = (char *)malloc(strlen(extra) + 32))) {
+    syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  sprintf(options, "id=%lu %s", xbus_request_id, extra);
+  xbus_send(opcode, topic, options, strlen(options));
+  xbus_request_count++;
+  free(options);
+
+  // return the identifier
+  return xbus_request_id;
+}
+
+// **************************************************************************
+// register a numeric alias of the topic
+unsigned int xbus_alias(const char *topic)
+{
+  unsigned long         id;
+  struct alias          *aliases;
+  char                  *copy;
+  size_t                i;
+
+  // send the packet ALIAS and receive the alias (zero means that the message broker has rejected it)
+  if (!(id = strtoul((char *)xbus_wait_reply(xbus_send_request(OP_ALIAS, topic, ""), NULL), NULL, 10))) {
+    return 0;
+  }
+
+  // add the alias to the sorted array unless it is already there
+  i = xbus_find_alias(id);
+  if (i < xbus_alias_count && xbus_aliases[i].id == id) {
+    return id;
+  }
+  if (!(aliases = (struct alias *)realloc(xbus_aliases, (xbus_alias_count + 1) * sizeof(*xbus_aliases))) ||
+      !(copy = strdup(topic))) {
+    syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  xbus_aliases = aliases;
+  memmove(&xbus_aliases[i + 1], &xbus_aliases[i], (xbus_alias_count - i) * sizeof(*xbus_aliases));
+  xbus_aliases[i].id    = id;
+  xbus_aliases[i].topic = copy;
+  xbus_alias_count++;
+
+  // return the alias
+  return id;
+}
+
+// **************************************************************************
+// publish the binary message by the alias of its topic
+void xbus_publish_alias(unsigned int alias, const void *payload, size_t size)
+{
+  // send the packet PUBLISH
+  xbus_send_alias(OP_PUBLISH, alias, payload, size);
+}
+
+// **************************************************************************
+// publish and store the binary message by the alias of its topic
+void xbus_write_alias(unsigned int alias, const void *payload, size_t size)
+{
+  // store the message forever
+  xbus_set_ttl(0);
+
+  // send the packet WRITE
+  xbus_send_alias(OP_WRITE, alias, payload, size);
+}
+
+// **************************************************************************
+// request a stored message without waiting for the reply
+unsigned long xbus_request_read(const char *topic)
+{
+  // send the packet READ
+  return xbus_send_request(OP_READ, topic, "");
+}
+
+// **************************************************************************
+// request all stored messages matching any of the topics separated by newline characters without waiting for them
+unsigned long xbus_request_bulk(const char *topics)
+{
+  unsigned long         id;
+  char                  *extra;
+
+  // send the packet READ with the topics following the options on separate lines of the payload
+  if (!(extra = (char *)malloc(strlen(topics) + 8))) {
+    syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
     exit(EXIT_FAILURE);
   }
+  sprintf(extra, "bulk=1\n%s", topics);
+  id = xbus_send_request(OP_READ, "%bulk", extra);
+  free(extra);
+  return id;
+}
+
+// **************************************************************************
+// request the list of stored messages without waiting for the reply
+unsigned long xbus_request_list(void)
+{
+  // send the packet LIST (the list is sent in parts)
+  return xbus_send_request(OP_LIST, "*", "parts=1");
+}
+
+// **************************************************************************
+// request the list of stored messages matching the topic with options of the list without waiting for the reply
+unsigned long xbus_request_list_options(const char *topic, const char *options)
+{
+  char                  extra[XBUS_MAX_SIZE];
+
+  // send the packet LIST with the options (the list is sent in parts)
+  snprintf(extra, sizeof(extra), "parts=1 %s", options);
+  return xbus_send_request(OP_LIST, topic, extra);
+}
+
+// **************************************************************************
+// read a stored message
+char *xbus_read(const char *topic)
+{
+  // return the reply to the packet READ
+  return (char *)xbus_wait_reply(xbus_request_read(topic), NULL);
+}
+
+// **************************************************************************
+// get the list of stored messages
+char *xbus_list(void)
+{
+  // return the reply to the packet LIST
+  return xbus_wait_list(xbus_request_list());
+}
+
+// **************************************************************************
+// get the list of stored messages matching the topic with options of the list
+char *xbus_list_options(const char *topic, const char *options)
+{
+  // return the reply to the packet LIST
+  return xbus_wait_list(xbus_request_list_options(topic, options));
+}
 
-  // split the packet content
-  buffer[sizeof(buffer) - 1] = '\0';
-  ptr = strchrnul(buffer, '\n');
-  if (*ptr) {
-    *ptr++ = '\0';
+// **************************************************************************
+// get the current version of the store
+unsigned long long xbus_version(void)
+{
+  // return the reply to the packet READ
+  return strtoull((char *)xbus_wait_reply(xbus_request_read("%version"), NULL), NULL, 10);
+}
+
+// **************************************************************************
+// set an option of the connection
+void xbus_option(const char *name, const char *value)
+{
+  // send the packet OPTION
+  xbus_send(OP_OPTION, name, value, strlen(value));
+}
+
+// **************************************************************************
+// receive a binary message
+void *xbus_receive_binary(char **topic, size_t *size)
+{
+  unsigned long         id;
+  char                  *name;
+  void                  *payload;
+  size_t                length;
+  int                   more;
+
+  // free the previously returned message or reply
+  free(xbus_returned);
+  xbus_returned = NULL;
+
+  // return the first message received while waiting for replies
+  if (xbus_first_message) {
+    xbus_returned      = xbus_first_message;
+    xbus_first_message = xbus_first_message->next_ptr;
+    if (!xbus_first_message) {
+      xbus_last_message = NULL;
+    }
+    name    = xbus_returned->topic;
+    length  = xbus_returned->size;
+    payload = xbus_returned->payload;
+  } else {
+
+    // receive packets until a message arrives (replies are kept until they are requested)
+    while ((payload = xbus_receive_next(&name, &length, &id, &more)) && id) {
+      xbus_keep_item(id, more, name, payload, length);
+    }
   }
 
   // return the message topic
   if (topic) {
-    *topic = buffer;
+    *topic = name;
   }
 
-  // return the message text
-  return ptr;
+  // return the size of the message payload
+  if (size) {
+    *size = length;
+  }
+
+  // return the message payload
+  return payload;
+}
+
+// **************************************************************************
+// wait for the next reply to the request with the correlation identifier
+static void *xbus_wait_item(unsigned long id, char **topic, size_t *size, int *more)
+{
+  struct item           *prev_ptr;
+  struct item           *item_ptr;
+  unsigned long         received;
+  char                  *name;
+  void                  *payload;
+  size_t                length;
+
+  // free the previously returned message or reply
+  free(xbus_returned);
+  xbus_returned = NULL;
+
+  // find the first reply among replies received before
+  for (prev_ptr = NULL, item_ptr = xbus_first_reply; item_ptr; prev_ptr = item_ptr, item_ptr = item_ptr->next_ptr) {
+    if (item_ptr->id == id) {
+      if (prev_ptr) {
+        prev_ptr->next_ptr = item_ptr->next_ptr;
+      } else {
+        xbus_first_reply = item_ptr->next_ptr;
+      }
+      if (xbus_last_reply == item_ptr) {
+        xbus_last_reply = prev_ptr;
+      }
+      xbus_returned = item_ptr;
+      *topic = item_ptr->topic;
+      *size  = item_ptr->size;
+      *more  = item_ptr->more;
+      return item_ptr->payload;
+    }
+  }
+
+  // receive packets until the reply arrives (messages and other replies are kept until they are requested)
+  while ((payload = xbus_receive_next(&name, &length, &received, more)) && received != id) {
+    xbus_keep_item(received, *more, name, payload, length);
+  }
+
+  // return the topic and the size of the payload
+  *topic = name;
+  *size  = length;
+
+  // return the payload
+  return payload;
+}
+
+// **************************************************************************
+// wait for the reply to the request with the correlation identifier
+void *xbus_wait_reply(unsigned long id, size_t *size)
+{
+  char                  *topic;
+  void                  *payload;
+  size_t                length;
+  int                   more;
+
+  // wait for the reply
+  payload = xbus_wait_item(id, &topic, &length, &more);
+
+  // return the size of the payload
+  if (size) {
+    *size = length;
+  }
+
+  // return the payload
+  return payload;
+}
+
+// **************************************************************************
+// wait for the next stored message of the bulk read (returns NULL after the last one)
+void *xbus_wait_bulk(unsigned long id, char **topic, size_t *size)
+{
+  char                  *name;
+  void                  *payload;
+  size_t                length;
+  int                   more;
+
+  // wait for the next reply
+  payload = xbus_wait_item(id, &name, &length, &more);
+
+  // the end-of-batch marker terminates the bulk read
+  if (!more) {
+    return NULL;
+  }
+
+  // return the message topic
+  if (topic) {
+    *topic = name;
+  }
+
+  // return the size of the message payload
+  if (size) {
+    *size = length;
+  }
+
+  // return the message payload
+  return payload;
+}
+
+// **************************************************************************
+// wait for all parts of the list of stored messages and join them
+char *xbus_wait_list(unsigned long id)
+{
+  char                  *listing;
+  char                  *part;
+  size_t                length;
+  size_t                size;
+
+  // append parts until the end-of-batch marker arrives (the buffer keeps space for the terminating null character)
+  length = 0;
+  size   = 0;
+  do {
+    part = (char *)xbus_wait_bulk(id, NULL, &size);
+    size = part ? size : 0;
+    if (length + size >= xbus_listing_size) {
+      if (!(listing = (char *)realloc(xbus_listing, length + size + XBUS_MAX_SIZE))) {
+        syslog(LOG_CRIT, "xbus: malloc error: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      xbus_listing      = listing;
+      xbus_listing_size = length + size + XBUS_MAX_SIZE;
+    }
+    if (size) {
+      memcpy(xbus_listing + length, part, size);
+      length += size;
+    }
+  } while (part);
+
+  // return the list terminated by a null character
+  xbus_listing[length] = '\0';
+  return xbus_listing;
+}
+
+// **************************************************************************
+// receive a message
+char *xbus_receive(char **topic)
+{
+  // receive a message and return its text
+  return (char *)xbus_receive_binary(topic, NULL);
 }
 
 // **************************************************************************
@@ -224,13 +1487,37 @@ char *xbus_receive(char **topic)
 int xbus_pending(void)
 {
   struct pollfd         pfd;
+  unsigned long         id;
+  char                  *name;
+  void                  *payload;
+  size_t                size;
+  int                   more;
+
+  // messages received while waiting for replies are pending
+  if (xbus_first_message) {
+    return 1;
+  }
 
   // prepare the structure content
   pfd.fd     = xbus_sk;
   pfd.events = POLLIN;
 
-  // detect the presence of unread data
-  return poll(&pfd, 1, 0) > 0;
+  // detect the presence of unread data if no reply is expected
+  if (!xbus_request_count) {
+    return poll(&pfd, 1, 0) > 0;
+  }
+
+  // keep received replies until a message arrives
+  while (poll(&pfd, 1, 0) > 0) {
+    payload = xbus_receive_next(&name, &size, &id, &more);
+    xbus_keep_item(id, more, name, payload, size);
+    if (!id) {
+      return 1;
+    }
+  }
+
+  // no message is pending
+  return 0;
 }
 
 // **************************************************************************
@@ -10,11 +10,14 @@
 #ifndef _XBUS_H_
 #define _XBUS_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// connect to the message broker
+// connect to the message broker (the environment variable XBUS_RING is
+// described in README.md)
 extern void xbus_connect(void);
 
 // disconnect from the message broker
@@ -23,6 +26,14 @@ extern void xbus_disconnect(void);
 // subscribe to the particular topic
 extern void xbus_subscribe(const char *topic);
 
+// subscribe to the particular topic with options separated by spaces
+// (see README.md)
+extern void xbus_subscribe_options(const char *topic, const char *options);
+
+// subscribe to the particular topic and receive only stored messages changed
+// after the version returned by xbus_version() (see README.md)
+extern void xbus_subscribe_since(const char *topic, unsigned long long version);
+
 // unsubscribe from the particular topic
 extern void xbus_unsubscribe(const char *topic);
 
@@ -32,15 +43,78 @@ extern void xbus_publish(const char *topic, const char *payload);
 // publish and store the message
 extern void xbus_write(const char *topic, const char *payload);
 
+// publish the binary message
+extern void xbus_publish_binary(const char *topic, const void *payload, size_t size);
+
+// publish and store the binary message
+extern void xbus_write_binary(const char *topic, const void *payload, size_t size);
+
+// publish and store the binary message which expires after the given number
+// of seconds up to one year
+extern void xbus_write_ttl(const char *topic, const void *payload, size_t size, unsigned long ttl);
+
+// register a numeric alias of the topic, the message broker then exchanges
+// messages on the topic with the alias instead of the topic (returns zero
+// if the alias is rejected)
+extern unsigned int xbus_alias(const char *topic);
+
+// publish the binary message by the alias of its topic
+extern void xbus_publish_alias(unsigned int alias, const void *payload, size_t size);
+
+// publish and store the binary message by the alias of its topic
+extern void xbus_write_alias(unsigned int alias, const void *payload, size_t size);
+
 // read a stored message
 extern char *xbus_read(const char *topic);
 
 // get the list of stored messages
 extern char *xbus_list(void);
 
-// receive a message
+// get the list of stored messages matching the topic with options separated
+// by spaces (see README.md)
+extern char *xbus_list_options(const char *topic, const char *options);
+
+// request a stored message without waiting for the reply, returns the
+// correlation identifier for xbus_wait_reply()
+extern unsigned long xbus_request_read(const char *topic);
+
+// request the list of stored messages without waiting for the reply, returns
+// the correlation identifier for xbus_wait_list()
+extern unsigned long xbus_request_list(void);
+
+// request the list of stored messages matching the topic with options without
+// waiting for the reply, see xbus_list_options()
+extern unsigned long xbus_request_list_options(const char *topic, const char *options);
+
+// request stored messages matching any of the topics separated by newlines,
+// returns the correlation identifier for xbus_wait_bulk()
+extern unsigned long xbus_request_bulk(const char *topics);
+
+// wait for the reply to the request with the correlation identifier and
+// return its payload (messages received meanwhile are kept for xbus_receive())
+extern void *xbus_wait_reply(unsigned long id, size_t *size);
+
+// wait for the next stored message of the bulk read with the correlation
+// identifier, returns NULL after the last one
+extern void *xbus_wait_bulk(unsigned long id, char **topic, size_t *size);
+
+// wait for the list of stored messages requested with the correlation
+// identifier
+extern char *xbus_wait_list(unsigned long id);
+
+// get the current version of the store, all changes of stored messages up to
+// it have been received on active subscriptions
+extern unsigned long long xbus_version(void);
+
+// set an option of the connection
+extern void xbus_option(const char *name, const char *value);
+
+// receive a message (rejected commands are reported on the topic "%error")
 extern char *xbus_receive(char **topic);
 
+// receive a binary message
+extern void *xbus_receive_binary(char **topic, size_t *size);
+
 // check pending unread messages
 extern int xbus_pending(void);
 
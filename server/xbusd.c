@@ -18,8 +18,23 @@
 #include <syslog.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <pwd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#ifdef XBUS_URING
+#include <poll.h>
+#include <linux/io_uring.h>
+#endif
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 // **************************************************************************
@@ -38,38 +53,703 @@
 // maximum packet size
 #define XBUS_MAX_SIZE   8192
 
+// maximum size of one part of a list of stored messages (the part fits into one packet with its topic)
+#define XBUS_LIST_SIZE  (XBUS_MAX_SIZE - 64)
+
+// default maximum size of a message payload
+#define XBUS_MAX_MESSAGE 1048576
+
+// maximum number of events processed in one iteration of the main loop
+#define XBUS_MAX_EVENTS 64
+
+// maximum number of packets received or sent by one system call
+#define XBUS_BATCH_SIZE 8
+
+// maximum number of descriptors passed along with one packet
+#define XBUS_MAX_FDS    2
+
+// minimum and maximum capacity of a shared ring buffer
+#define XBUS_RING_MIN   32768
+#define XBUS_RING_MAX   16777216
+
+// initial number of buckets of the subscription index hash table
+#define XBUS_HASH_SIZE  256
+
+// initial number of buckets of the hash table of conflation slots of a client
+#define XBUS_SLOT_HASH_SIZE 16
+
+// default maximum number of packets in the output queue of a client
+#define XBUS_QUEUE_SIZE 256
+
+// number of packets which can be handed off to a sending thread at once (must be a power of two)
+#define XBUS_HANDOFF_SIZE 4096
+
+// maximum number of sending threads
+#define XBUS_MAX_WORKERS 64
+
+// number of entries of the io_uring submission queue and completion queue
+#define XBUS_URING_ENTRIES 256
+#define XBUS_URING_COMPLETIONS 4096
+
+// number of buffers provided to the io_uring instance for received packets (must be a power of two)
+#define XBUS_URING_BUFFERS 64
+
+// default processing quota of a client per iteration of the main loop
+#define XBUS_QUOTA      64
+
+// size and alignment of a slab from which records and strings are carved (must be a power of two)
+#define XBUS_SLAB_SIZE  16384
+
+// offset of the first chunk of a slab (chunks follow the header of the slab)
+#define XBUS_SLAB_START ((sizeof(struct slab) + 15) & ~(size_t)15)
+
+// number of size classes of the string arena (powers of two from 16 bytes, larger blocks are allocated separately)
+#define XBUS_ARENA_CLASSES 9
+
+// identification at the beginning of files of the persistent store
+#define XBUS_STORE_MAGIC "XBUSSTR1"
+#define XBUS_STORE_MAGIC_SIZE 8
+
+// payload size of a record of the persistent store which removes a stored message
+#define XBUS_RECORD_REMOVED 0xffffffff
+
+// minimum size of the journal of the persistent store which triggers its compaction into the snapshot
+#define XBUS_JOURNAL_SIZE 1048576
+
+// size of the buffer for writing the snapshot of the persistent store
+#define XBUS_SNAPSHOT_BUFFER 65536
+
+// number of levels of the timer wheel, number of slots of each level (as a power of two) and duration of one tick
+// in milliseconds
+#define XBUS_WHEEL_LEVELS 4
+#define XBUS_WHEEL_BITS 6
+#define XBUS_TICK       10
+
+// maximum rate of messages on a topic per second which can be requested by a subscription (the interval between
+// messages cannot be shorter than one tick of the timer wheel)
+#define XBUS_MAX_RATE   (1000 / XBUS_TICK)
+
+// maximum time to live of stored messages in seconds (one year)
+#define XBUS_MAX_TTL    31536000
+
+// time to live of empty messages replacing expired ones in milliseconds (one hour)
+#define XBUS_TOMBSTONE_TTL 3600000
+
+// types of subscription index nodes
+#define NODE_LITERAL    0
+#define NODE_PLUS       1
+#define NODE_STAR       2
+
+// types of payload filters (the order of comparisons matches the array of operator names)
+#define FILTER_PREFIX       0
+#define FILTER_EQUAL        1
+#define FILTER_LESS         2
+#define FILTER_LESS_EQUAL   3
+#define FILTER_GREATER      4
+#define FILTER_GREATER_EQUAL 5
+#define FILTER_NUMBER_EQUAL 6
+#define FILTER_NOT_EQUAL    7
+
+// types of timers
+#define TIMER_MESSAGE       0
+#define TIMER_CONFLATION    1
+#define TIMER_COMPACTION    2
+#define TIMER_BATCH         3
+
+// overflow policies of output queues
+#define POLICY_DROP_NEWEST  0
+#define POLICY_DROP_OLDEST  1
+#define POLICY_DISCONNECT   2
+
+// operation codes of binary packets
+#define OP_MESSAGE      0
+#define OP_PUBLISH      1
+#define OP_WRITE        2
+#define OP_READ         3
+#define OP_SUBSCRIBE    4
+#define OP_UNSUBSCRIBE  5
+#define OP_LIST         6
+#define OP_OPTION       7
+#define OP_HELLO        8
+#define OP_CONTINUE     9
+#define OP_RING         10
+#define OP_ALIAS        11
+#define OP_REPLY        12
+
+// details of stored messages sent in batches of replies (lists or messages themselves)
+#define LIST_TOPICS     0
+#define LIST_SIZES      1
+#define LIST_VALUES     2
+#define LIST_MESSAGES   3
+
+// flags of binary packets
+#define FLAG_MORE       0x0001
+#define FLAG_MEMFD      0x0002
+#define FLAG_ALIAS      0x0004
+#define FLAG_EXPIRED    0x0008
+#define FLAG_BULK       0x0010
+
+// priority classes of clients
+#define PRIORITY_NORMAL     0
+#define PRIORITY_HIGH       1
+
+// kinds of io_uring operations (stored in the lowest bits of the user data along with a pointer to the client)
+#define TAG_NONE        0
+#define TAG_ACCEPT      1
+#define TAG_RECEIVE     2
+#define TAG_SEND        3
+#define TAG_POLL        4
+#define TAG_MASK        7
+
 // **************************************************************************
 
-// stored message
-struct message {
+// header of a binary packet (followed by the topic, a null character and the payload)
+struct header {
+  uint8_t               marker;
+  uint8_t               opcode;
+  uint16_t              flags;
+  uint32_t              topic_size;
+  uint32_t              payload_size;
+};
+
+// encoded packet shared by all its recipients (a packet with the alias of the topic shares the payload of its origin)
+struct packet {
+  unsigned int          refs;
   size_t                size;
-  char                  *topic;
+  size_t                topic_size;
+  size_t                payload_size;
   char                  *payload;
-  struct message        *next_ptr;
+  int                   fd;
+  struct packet         *origin_ptr;
+  struct header         header;
+  char                  data[];
+};
+
+// buffer for a control message carrying descriptors
+union control {
+  struct cmsghdr        header;
+  char                  data[CMSG_SPACE(XBUS_MAX_FDS * sizeof(int))];
+};
+
+// shared ring buffer of packets sent by a client (a single producer and a single consumer)
+struct ring {
+  uint32_t              head;
+  uint32_t              sleeping;
+  uint8_t               reserved1[56];
+  uint32_t              tail;
+  uint32_t              waiting;
+  uint8_t               reserved2[56];
+  char                  data[];
+};
+
+// packet handed off to a sending thread (a null packet means that the client is closed)
+struct handoff {
+  struct client         *client_ptr;
+  struct packet         *packet_ptr;
+};
+
+// sending thread serving output queues of a part of clients (the handoff queue has a single producer and a single consumer)
+struct worker {
+  pthread_t             thread;
+  int                   epoll_fd;
+  int                   event_fd;
+  int                   pending;
+  uint32_t              tail;
+  uint8_t               reserved1[40];
+  uint32_t              head;
+  uint32_t              sleeping;
+  uint32_t              waiting;
+  uint8_t               reserved2[52];
+  struct handoff        *queue;
+  struct client         *flush_client_ptr;
+  struct client         *closed_client_ptr;
+};
+
+#ifdef XBUS_URING
+// io_uring instance with mapped queues and provided buffers
+struct uring {
+  int                   fd;
+  unsigned int          sq_entries;
+  unsigned int          sq_mask;
+  unsigned int          sq_tail;
+  unsigned int          *sq_head_ptr;
+  unsigned int          *sq_tail_ptr;
+  unsigned int          cq_mask;
+  unsigned int          *cq_head_ptr;
+  unsigned int          *cq_tail_ptr;
+  struct io_uring_sqe   *sqes;
+  struct io_uring_cqe   *cqes;
+  struct io_uring_buf_ring *buffer_ring;
+  uint16_t              buffer_tail;
+  char                  *buffers;
+};
+
+// layout of a provided buffer (the header and descriptors are filled in by the kernel)
+struct buffer {
+  struct io_uring_recvmsg_out header;
+  union control         control;
+  char                  data[XBUS_MAX_SIZE];
+};
+
+// batch of packets being sent to a client by the io_uring instance
+struct transmit {
+  int                   count;
+  int                   done;
+  struct packet         *packets[XBUS_BATCH_SIZE];
+  struct msghdr         msgs[XBUS_BATCH_SIZE];
+  struct iovec          iovs[XBUS_BATCH_SIZE][4];
+  struct header         headers[XBUS_BATCH_SIZE];
+  union control         controls[XBUS_BATCH_SIZE];
+};
+#endif
+
+// slab carved into chunks of a pool (free chunks are linked through their first word, slabs with free chunks are
+// linked in the pool and an empty slab is returned to the system)
+struct slab {
+  void                  *free_ptr;
+  size_t                used;
+  struct slab           *prev_ptr;
+  struct slab           *next_ptr;
+};
+
+// pool of equally sized chunks carved from slabs
+struct pool {
+  size_t                size;
+  struct slab           *slab_ptr;
+};
+
+// block of the string arena (the size is needed to return the block to its pool)
+struct chunk {
+  size_t                size;
+  char                  data[];
 };
 
-// message subscription
+// interned topic or topic pattern shared by all subscriptions and stored messages (interned topics are compared by pointer)
+struct topic {
+  unsigned int          hash;
+  unsigned int          refs;
+  unsigned int          id;
+  size_t                length;
+  struct message        *message_ptr;
+  struct recipient_cache *cache_ptr;
+  struct topic          *next_ptr;
+  char                  name[];
+};
+
+// subscriptions matching a topic published by an alias (valid until the generation of subscriptions changes, the flag
+// tells whether the subscriber has registered the alias too)
+struct recipient_cache {
+  unsigned long         generation;
+  size_t                count;
+  struct {
+    struct subscribe    *subscribe_ptr;
+    int                 aliased;
+  }                     entries[];
+};
+
+// header of a record of the persistent store (followed by the topic, a null character and the payload),
+// the expiration time is in milliseconds of the real time clock
+struct record {
+  uint32_t              topic_size;
+  uint32_t              payload_size;
+  uint64_t              expires;
+  uint64_t              version;
+};
+
+// snapshot of the persistent store being written
+struct snapshot {
+  int                   fd;
+  int                   failed;
+  size_t                size;
+  size_t                length;
+  char                  buffer[XBUS_SNAPSHOT_BUFFER];
+};
+
+// stored message collected for the compaction of the persistent store (the topic and the packet are held until
+// the compaction finishes)
+struct compacted {
+  struct topic          *topic_ptr;
+  struct packet         *packet_ptr;
+  uint64_t              expires;
+  uint64_t              version;
+};
+
+// timer of the timer wheel (the expiration time is in milliseconds of the monotonic clock, zero means that the timer
+// is not scheduled)
+struct timer {
+  int                   type;
+  uint64_t              expires;
+  struct timer          *next_ptr;
+  struct timer          **link_ptr;
+};
+
+// stored message (the timer expires the message, the version is the value of the version counter of the store when
+// the message was last changed, the mark detects messages matching several topics of one request)
+struct message {
+  struct topic          *topic_ptr;
+  struct packet         *packet_ptr;
+  struct store_node     *node_ptr;
+  struct timer          timer;
+  uint64_t              version;
+  unsigned long         mark;
+  struct message        *lru_prev_ptr;
+  struct message        *lru_next_ptr;
+  size_t                size;
+};
+
+// node of the radix tree of stored messages
+struct store_node {
+  char                  *key;
+  size_t                length;
+  size_t                count;
+  struct store_node     **children;
+  struct message        *message_ptr;
+  struct store_node     *parent_ptr;
+};
+
+// latest message on a topic held back for a client whose subscription limits the rate of messages (the time of the
+// last delivery and the interval are in milliseconds of the monotonic clock, the slot is destroyed once nothing
+// arrives during the interval after a delivery)
+struct conflation {
+  struct topic          *topic_ptr;
+  struct client         *client_ptr;
+  struct packet         *packet_ptr;
+  uint64_t              sent;
+  unsigned long         interval;
+  struct timer          timer;
+  struct conflation     *next_ptr;
+};
+
+// parameters of sending stored messages to a new subscriber
+struct replay {
+  struct subscribe      *subscribe_ptr;
+  uint64_t              since;
+};
+
+// stored messages being sent to a client as replies to one request (packets from the index on are still held,
+// sending pauses while the output queue of the client is full, messages are sent themselves or listed in parts
+// built in the buffer, the filter of payloads is used while the messages are collected)
+struct batch {
+  unsigned long         id;
+  int                   details;
+  struct filter         *filter_ptr;
+  size_t                index;
+  size_t                count;
+  size_t                size;
+  struct packet         **packets;
+  char                  *data;
+  size_t                data_length;
+  size_t                data_size;
+  struct batch          *next_ptr;
+};
+
+// predicate on payloads of messages (a text compared with the payload or a key of the field "key=value" whose
+// numeric value is compared with the number)
+struct filter {
+  int                   type;
+  double                number;
+  size_t                length;
+  char                  text[];
+};
+
+// message subscription (the interval is the minimum time between messages on a topic in milliseconds, zero means
+// that messages are not limited, messages can be also limited by the filter of their payloads)
 struct subscribe {
-  char                  *topic;
+  struct topic          *topic_ptr;
+  struct client         *client_ptr;
+  unsigned long         interval;
+  struct filter         *filter_ptr;
+  struct index_node     *node_ptr;
+  struct subscribe      *index_prev_ptr;
+  struct subscribe      *index_next_ptr;
   struct subscribe      *next_ptr;
 };
 
+// node of the subscription index (one level of a topic pattern)
+struct index_node {
+  int                   type;
+  char                  *segment;
+  size_t                length;
+  unsigned int          hash;
+  unsigned int          count;
+  struct index_node     *parent_ptr;
+  struct index_node     *plus_ptr;
+  struct index_node     *star_ptr;
+  struct subscribe      *subscribe_ptr;
+  struct index_node     *next_ptr;
+};
+
+// fragmented message being assembled
+struct assembly {
+  struct header         header;
+  size_t                length;
+  char                  data[];
+};
+
 // client data
 struct client {
   int                   sk;
+  int                   closed;
+  int                   broken;
+  int                   binary;
+  int                   memfd;
+  int                   discarding;
+  int                   blocked;
+  int                   flushing;
+  int                   overflow;
+  int                   policy;
+  int                   priority;
+  uint32_t              events;
+  struct ucred          cred;
+  struct worker         *worker_ptr;
+  struct ring           *ring_ptr;
+  size_t                ring_size;
+  uint32_t              ring_head;
+  int                   ring_fd;
+#ifdef XBUS_URING
+  int                   ops;
+  int                   hangup;
+  int                   deferred;
+  int                   poll_fd;
+  size_t                quota;
+  unsigned long         round;
+  struct transmit       *transmit_ptr;
+#endif
   char                  *name;
+  unsigned long         mark;
+  unsigned long         alias_mark;
+  unsigned long         dropped;
+  unsigned long         throttled;
+  unsigned long         rejected;
+  unsigned long         conflated;
+  unsigned long         interval;
+  size_t                queue_limit;
+  unsigned long         write_ttl;
+  int                   skip_unchanged;
+  size_t                queue_size;
+  size_t                queue_head;
+  size_t                queue_count;
+  size_t                queue_offset;
+  struct packet         **queue;
+  struct assembly       *assembly_ptr;
   struct subscribe      *subscribe_ptr;
+  struct topic          **aliases;
+  size_t                alias_count;
+  struct conflation     **slot_table;
+  size_t                slot_table_size;
+  size_t                slot_count;
+  size_t                limited_count;
+  struct batch          *batch_ptr;
+  struct timer          batch_timer;
+  struct client         *flush_next_ptr;
+  struct client         *prev_ptr;
   struct client         *next_ptr;
 };
 
 // **************************************************************************
 
-// pointer to the beginning of the list of stored messages
-static struct message   *first_message_ptr = NULL;
+// pools of records
+static struct pool      client_pool        = { sizeof(struct client), NULL };
+static struct pool      subscribe_pool     = { sizeof(struct subscribe), NULL };
+static struct pool      index_pool         = { sizeof(struct index_node), NULL };
+static struct pool      message_pool       = { sizeof(struct message), NULL };
+static struct pool      store_pool         = { sizeof(struct store_node), NULL };
+static struct pool      conflation_pool    = { sizeof(struct conflation), NULL };
+
+// pools of the string arena for topics, keys, names and packets
+static struct pool      arena_pools[XBUS_ARENA_CLASSES] = {
+  { 16, NULL }, { 32, NULL }, { 64, NULL }, { 128, NULL }, { 256, NULL }, { 512, NULL }, { 1024, NULL }, { 2048, NULL }, { 4096, NULL }
+};
+
+// lock of the pools and of the memory statistics (records, names and packets are also freed by sending threads)
+static pthread_mutex_t  memory_mutex       = PTHREAD_MUTEX_INITIALIZER;
+
+// memory used by records, strings, packets and buffers, memory taken from the system for them and the total budget
+// (0 = unlimited)
+static size_t           memory_used        = 0;
+static size_t           memory_reserved    = 0;
+static size_t           memory_limit       = 0;
+
+// flag whether the memory budget has been exhausted
+static int              memory_exhausted   = 0;
+
+// files of the persistent store (the snapshot, the journal of later writes, the journal replaced during compaction,
+// a temporary file for compaction and the directory containing them)
+static const char       *store_path        = NULL;
+static char             *journal_path      = NULL;
+static char             *old_journal_path  = NULL;
+static char             *temp_path         = NULL;
+static char             *directory_path    = NULL;
+
+// descriptor and size of the journal and size of the snapshot of the persistent store
+static int              journal_fd         = -1;
+static size_t           journal_size       = 0;
+static size_t           snapshot_size      = 0;
+
+// compaction of the persistent store (the timer starts it and polls the thread writing the snapshot, the old journal
+// is kept until a snapshot containing its records replaces the old one)
+static struct timer     compaction_timer   = { TIMER_COMPACTION, 0, NULL, NULL };
+static pthread_t        compaction_thread;
+static int              compaction_running = 0;
+static int              compaction_done    = 0;
+static int              compaction_failed  = 0;
+static int              old_journal        = 0;
+static struct compacted *compacted         = NULL;
+static size_t           compacted_count    = 0;
+static size_t           compacted_size     = 0;
+static uint64_t         compacted_floor    = 0;
+static struct snapshot  snapshot;
+
+// root node of the radix tree of stored messages
+static struct store_node store_root        = { NULL, 0, 0, NULL, NULL, NULL };
+
+// list of stored messages from the most recently used one
+static struct message   *lru_first_ptr     = NULL;
+static struct message   *lru_last_ptr      = NULL;
+
+// number and size of stored messages and their limits (0 = unlimited)
+static size_t           store_count        = 0;
+static size_t           store_size         = 0;
+static size_t           store_count_limit  = 0;
+static size_t           store_size_limit   = 0;
+
+// version counter of the store (incremented by each change of a stored message, it starts from the current time
+// in microseconds so that versions keep growing across restarts of the message broker)
+static uint64_t         store_version      = 0;
+
+// lowest version of the store from which all changes are still known (changes of evicted messages are lost, so
+// subscribers knowing an older version get all stored messages again)
+static uint64_t         store_floor        = 0;
+
+// statistics of stored messages removed due to the limits and due to expiration
+static unsigned long    evicted_count      = 0;
+static unsigned long    evicted_size       = 0;
+static unsigned long    expired_count      = 0;
+
+// timer wheel, the next tick to be processed and the number of scheduled timers
+static struct timer     *timer_wheel[XBUS_WHEEL_LEVELS][1 << XBUS_WHEEL_BITS];
+static uint64_t         timer_tick         = 0;
+static size_t           timer_count        = 0;
 
 // pointer to the beginning of the list of clients
 static struct client    *first_client_ptr  = NULL;
 
+// pointer to the beginning of the list of closed clients
+static struct client    *closed_client_ptr = NULL;
+
+// pointer to the beginning of the list of clients with unsent packets
+static struct client    *flush_client_ptr  = NULL;
+
+// buffers for received packets
+static char             receive_buffers[XBUS_BATCH_SIZE][XBUS_MAX_SIZE];
+
+#ifndef XBUS_URING
+// buffers for descriptors received along with packets
+static union control    receive_controls[XBUS_BATCH_SIZE];
+#endif
+
+// epoll instance descriptor
+static int              epoll_fd           = -1;
+
+// spare descriptor released to refuse connections when descriptors run out
+static int              spare_fd           = -1;
+
+// connections are being refused
+static int              refusing           = 0;
+
+// default maximum number of packets in the output queue of a client
+static size_t           queue_limit        = XBUS_QUEUE_SIZE;
+
+// maximum size of a message payload
+static size_t           message_limit      = XBUS_MAX_MESSAGE;
+
+// default overflow policy of output queues
+static int              queue_policy       = POLICY_DROP_NEWEST;
+
+// names of overflow policies
+static const char       *policy_names[]    = { "drop-newest", "drop-oldest", "disconnect", NULL };
+
+// names of commands indexed by their operation codes
+static const char       *command_names[]   = { "MESSAGE", "PUBLISH", "WRITE", "READ", "SUBSCRIBE", "UNSUBSCRIBE",
+                                               "LIST", "OPTION", "HELLO", "CONTINUE", "RING", "ALIAS", "REPLY", NULL };
+
+// names of comparison operators of payload filters
+static const char       *operator_names[]  = { "<", "<=", ">", ">=", "==", "!=", NULL };
+
+// processing quota of a client per iteration of the main loop
+static size_t           client_quota       = XBUS_QUOTA;
+
+// names of processes and users with high priority
+static const char       **priority_processes = NULL;
+static size_t           priority_process_count = 0;
+static uid_t            *priority_users    = NULL;
+static size_t           priority_user_count = 0;
+
+// number of packets queued for sending since the start of the broker
+static unsigned long    work_count         = 0;
+
+// root node of the subscription index
+static struct index_node index_root        = { NODE_LITERAL, NULL, 0, 0, 0, NULL, NULL, NULL, NULL, NULL };
+
+// hash table of literal nodes of the subscription index
+static struct index_node **index_table     = NULL;
+static size_t           index_table_size   = 0;
+static size_t           index_table_count  = 0;
+
+// hash table of interned topics
+static struct topic     **topic_table      = NULL;
+static size_t           topic_table_size   = 0;
+static size_t           topic_table_count  = 0;
+
+// identifier of the last interned topic (used also as the alias of the topic)
+static unsigned int     topic_last_id      = 0;
+
+// number of topic aliases registered by all clients
+static size_t           alias_total        = 0;
+
+// subscriptions which do not fit into the subscription index
+static struct subscribe *fallback_ptr      = NULL;
+
+// array of recipients of the dispatched message
+static struct client    **recipients       = NULL;
+static size_t           recipients_size    = 0;
+static size_t           recipients_count   = 0;
+
+// mark of the dispatched message used to detect duplicate recipients
+static unsigned long    dispatch_mark      = 0;
+
+// generation of subscriptions and aliases (changes invalidate caches of recipients)
+static unsigned long    cache_generation   = 0;
+
+// array of subscriptions collected for a cache of recipients
+static struct subscribe **collected        = NULL;
+static size_t           collected_size     = 0;
+static size_t           collected_count    = 0;
+
+// mark of the request collecting stored messages used to detect duplicate messages
+static unsigned long    batch_mark         = 0;
+
+// sending threads (none means that clients are served by the main thread only)
+static struct worker    *workers           = NULL;
+static size_t           worker_count       = 0;
+static size_t           worker_next        = 0;
+
+#ifdef XBUS_URING
+// io_uring instance
+static struct uring     uring;
+
+// message header describing the layout of provided buffers
+static struct msghdr    receive_msghdr;
+
+// completions of io_uring operations (completions deferred due to an exhausted quota come first)
+static struct io_uring_cqe *completions    = NULL;
+static size_t           completion_size    = 0;
+static size_t           completion_count   = 0;
+
+// number of the iteration of the main loop used to renew processing quotas
+static unsigned long    round_count        = 0;
+#endif
+
 // **************************************************************************
 // safe memory allocation
 static void *safe_alloc(size_t size)
@@ -87,180 +767,415 @@ static void *safe_alloc(size_t size)
 }
 
 // **************************************************************************
-// safe string duplication
-static char *safe_strdup(const char *str)
+// safe memory reallocation
+static void *safe_realloc(void *ptr, size_t size)
 {
-  char                  *ptr;
-
-  // create a copy of the string
-  if (!(ptr = strdup(str))) {
-    syslog(LOG_CRIT, "strdup error: %s", strerror(errno));
+  // reallocate memory
+  if (!(ptr = realloc(ptr, size))) {
+    syslog(LOG_CRIT, "realloc error: %s", strerror(errno));
     exit(EXIT_FAILURE);
   }
 
-  // return a pointer to the copy of the string
+  // return a pointer to the reallocated memory
   return ptr;
 }
 
 // **************************************************************************
-// open a UNIX socket
-static int open_unix_socket(const char *path)
+// map a slab aligned to its size, so that a chunk finds its slab (a twice larger mapping is trimmed)
+static struct slab *map_slab(void)
 {
-  struct sockaddr_un    addr;
-  int                   sk;
+  char                  *ptr;
+  size_t                offset;
 
-  // create a new socket
-  if ((sk = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
-    syslog(LOG_CRIT, "create socket error: %s", strerror(errno));
+  // map memory
+  if ((ptr = (char *)mmap(NULL, 2 * XBUS_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+    syslog(LOG_CRIT, "mmap error: %s", strerror(errno));
     exit(EXIT_FAILURE);
   }
 
-  // bind the socket to the path
-  memset(&addr, 0, sizeof(addr));
-  addr.sun_family = AF_UNIX;
-  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
-  unlink(addr.sun_path);
-  if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
-    syslog(LOG_CRIT, "bind socket error: %s", strerror(errno));
-    exit(EXIT_FAILURE);
+  // unmap memory before and after the aligned slab
+  offset = -(uintptr_t)ptr & (XBUS_SLAB_SIZE - 1);
+  if (offset) {
+    munmap(ptr, offset);
   }
+  munmap(ptr + offset + XBUS_SLAB_SIZE, XBUS_SLAB_SIZE - offset);
 
-  // initialize listening for connection requests
-  if (listen(sk, 8) != 0) {
-    syslog(LOG_CRIT, "listen on socket error: %s", strerror(errno));
-    exit(EXIT_FAILURE);
+  // return a pointer to the slab
+  return (struct slab *)(ptr + offset);
+}
+
+// **************************************************************************
+// add the slab to the beginning of the list of slabs with free chunks
+static void link_slab(struct pool *pool_ptr, struct slab *slab_ptr)
+{
+  slab_ptr->prev_ptr = NULL;
+  slab_ptr->next_ptr = pool_ptr->slab_ptr;
+  if (pool_ptr->slab_ptr) {
+    pool_ptr->slab_ptr->prev_ptr = slab_ptr;
   }
+  pool_ptr->slab_ptr = slab_ptr;
+}
 
-  // return the assigned socket descriptor
-  return sk;
+// **************************************************************************
+// remove the slab from the list of slabs with free chunks
+static void unlink_slab(struct pool *pool_ptr, struct slab *slab_ptr)
+{
+  if (slab_ptr->prev_ptr) {
+    slab_ptr->prev_ptr->next_ptr = slab_ptr->next_ptr;
+  } else {
+    pool_ptr->slab_ptr = slab_ptr->next_ptr;
+  }
+  if (slab_ptr->next_ptr) {
+    slab_ptr->next_ptr->prev_ptr = slab_ptr->prev_ptr;
+  }
 }
 
 // **************************************************************************
-// find process name for the client
-static const char *get_name(struct client *client_ptr)
+// allocate a chunk from the pool
+static void *pool_alloc(struct pool *pool_ptr)
 {
-  struct ucred          peercred;
-  socklen_t             optlen;
-  ssize_t               size;
-  char                  name[64];
-  char                  *ptr;
-  int                   fd;
+  struct slab           *slab_ptr;
+  char                  *chunk;
+  void                  *ptr;
+  size_t                i;
 
-  // return the process name if already found
-  if (client_ptr->name) {
-    return client_ptr->name;
-  }
+  pthread_mutex_lock(&memory_mutex);
 
-  // find the PID of the client
-  optlen = sizeof(peercred);
-  if (getsockopt(client_ptr->sk, SOL_SOCKET, SO_PEERCRED, &peercred, &optlen) != 0) {
-    return "?";
+  // carve a new slab into free chunks if no slab has a free chunk
+  if (!(slab_ptr = pool_ptr->slab_ptr)) {
+    slab_ptr = map_slab();
+    slab_ptr->free_ptr = NULL;
+    slab_ptr->used     = 0;
+    for (i = (XBUS_SLAB_SIZE - XBUS_SLAB_START) / pool_ptr->size; i--; ) {
+      chunk = (char *)slab_ptr + XBUS_SLAB_START + i * pool_ptr->size;
+      *(void **)chunk = slab_ptr->free_ptr;
+      slab_ptr->free_ptr = chunk;
+    }
+    link_slab(pool_ptr, slab_ptr);
+    memory_reserved += XBUS_SLAB_SIZE;
   }
 
-  // read process information
-  snprintf(name, sizeof(name), "/proc/%d/status", peercred.pid);
-  if ((fd = open(name, O_RDONLY)) < 0) {
-    return "?";
+  // take the first free chunk of the slab
+  ptr = slab_ptr->free_ptr;
+  slab_ptr->free_ptr = *(void **)ptr;
+  slab_ptr->used++;
+  if (!slab_ptr->free_ptr) {
+    unlink_slab(pool_ptr, slab_ptr);
   }
-  size = read(fd, name, sizeof(name) - 1);
-  name[size > 0 ? size : 0] = '\0';
-  close(fd);
+  memory_used += pool_ptr->size;
 
-  // find process name
-  strtok(name, "\t");
-  if (!(ptr = strtok(NULL, "\n"))) {
-    return "?";
-  }
+  pthread_mutex_unlock(&memory_mutex);
 
-  // save and return the found process name
-  return client_ptr->name = safe_strdup(ptr);
+  // return a pointer to the chunk
+  return ptr;
 }
 
 // **************************************************************************
-// send the packet to the client
-static void send_packet(struct client *client_ptr, const char *topic, const char *payload)
+// return the chunk to the pool
+static void pool_free(struct pool *pool_ptr, void *ptr)
 {
-  char                  buffer[XBUS_MAX_SIZE];
+  struct slab           *slab_ptr;
 
-  // create the packet content
-  snprintf(buffer, sizeof(buffer), "%s\n%s", topic, payload);
+  pthread_mutex_lock(&memory_mutex);
 
-  // send the packet to the client
-  if (send(client_ptr->sk, buffer, strlen(buffer) + 1, MSG_EOR | MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
-    if (errno != ECONNRESET && errno != ECONNREFUSED && errno != EPIPE) {
-      syslog(LOG_WARNING, "process %s lost packet", get_name(client_ptr));
-    }
+  // put the chunk at the beginning of the list of free chunks of its slab
+  slab_ptr = (struct slab *)((uintptr_t)ptr & ~(uintptr_t)(XBUS_SLAB_SIZE - 1));
+  if (!slab_ptr->free_ptr) {
+    link_slab(pool_ptr, slab_ptr);
+  }
+  *(void **)ptr = slab_ptr->free_ptr;
+  slab_ptr->free_ptr = ptr;
+  slab_ptr->used--;
+  memory_used -= pool_ptr->size;
+
+  // return an empty slab to the system unless it is the only slab with free chunks (which avoids repeated
+  // allocation of a slab when a single chunk is allocated and freed)
+  if (!slab_ptr->used && (pool_ptr->slab_ptr != slab_ptr || slab_ptr->next_ptr)) {
+    unlink_slab(pool_ptr, slab_ptr);
+    munmap(slab_ptr, XBUS_SLAB_SIZE);
+    memory_reserved -= XBUS_SLAB_SIZE;
   }
+
+  pthread_mutex_unlock(&memory_mutex);
 }
 
 // **************************************************************************
-// create a client record
-static void create_client(int sk)
+// account memory allocated outside of pools (buffers, large blocks of the string arena and mapped payloads)
+static void charge_memory(size_t size)
 {
-  struct client         *this_ptr;
+  pthread_mutex_lock(&memory_mutex);
+  memory_used     += size;
+  memory_reserved += size;
+  pthread_mutex_unlock(&memory_mutex);
+}
 
-  // create a new record
-  this_ptr = (struct client *)safe_alloc(sizeof(*this_ptr));
+// **************************************************************************
+// account memory freed outside of pools (it may be also freed by sending threads)
+static void discharge_memory(size_t size)
+{
+  pthread_mutex_lock(&memory_mutex);
+  memory_used     -= size;
+  memory_reserved -= size;
+  pthread_mutex_unlock(&memory_mutex);
+}
 
-  // set the content of the new record
-  this_ptr->sk            = sk;
-  this_ptr->name          = NULL;
-  this_ptr->subscribe_ptr = NULL;
+// **************************************************************************
+// find the size class of the string arena for the block (returns XBUS_ARENA_CLASSES for too large blocks)
+static size_t find_arena_class(size_t size)
+{
+  size_t                i;
 
-  // add the new record to the list of clients
-  this_ptr->next_ptr = first_client_ptr;
-  first_client_ptr   = this_ptr;
+  // find the smallest class which fits the block including its header
+  size += sizeof(struct chunk);
+  for (i = 0; i < XBUS_ARENA_CLASSES && arena_pools[i].size < size; i++)
+    ;
 
-  // write information to the log
-  debuglog("process %s connected", get_name(this_ptr));
+  // return the index of the class
+  return i;
 }
 
 // **************************************************************************
-// destroy a client record
-static void destroy_client(int sk)
+// find the amount of memory charged for the block of the string arena
+static size_t get_arena_size(size_t size)
 {
-  struct client         *prev_ptr;
-  struct client         *this_ptr;
-  struct subscribe      *next_ptr;
-  struct subscribe      *temp_ptr;
-
-  // find a client record according to the socket descriptor
-  prev_ptr = NULL;
-  this_ptr = first_client_ptr;
-  while (this_ptr && this_ptr->sk != sk) {
-    prev_ptr = this_ptr;
-    this_ptr = this_ptr->next_ptr;
-  }
+  size_t                i;
 
-  // stop if a client record was not found
-  if (!this_ptr) {
-    return;
-  }
+  // return the size of the class or the size of a separately allocated block
+  i = find_arena_class(size);
+  return i < XBUS_ARENA_CLASSES ? arena_pools[i].size : sizeof(struct chunk) + size;
+}
 
-  // write information to the log
-  debuglog("process %s disconnected", get_name(this_ptr));
+// **************************************************************************
+// allocate a block from the string arena
+static void *arena_alloc(size_t size)
+{
+  struct chunk          *chunk_ptr;
+  size_t                i;
 
-  // remove an entry from the list of clients
-  if (prev_ptr) {
-    prev_ptr->next_ptr = this_ptr->next_ptr;
-  } else {
-    first_client_ptr = this_ptr->next_ptr;
+  // allocate the block from the pool of its size class
+  i = find_arena_class(size);
+  if (i < XBUS_ARENA_CLASSES) {
+    chunk_ptr = (struct chunk *)pool_alloc(&arena_pools[i]);
+    chunk_ptr->size = arena_pools[i].size;
+    return chunk_ptr->data;
   }
 
-  // destroy the list of subscribed topics
-  temp_ptr = this_ptr->subscribe_ptr;
-  while (temp_ptr) {
-    next_ptr = temp_ptr->next_ptr;
-    free(temp_ptr->topic);
-    free(temp_ptr);
-    temp_ptr = next_ptr;
+  // allocate a too large block separately
+  chunk_ptr = (struct chunk *)safe_alloc(sizeof(*chunk_ptr) + size);
+  chunk_ptr->size = sizeof(*chunk_ptr) + size;
+  charge_memory(chunk_ptr->size);
+
+  // return a pointer to the usable part of the block
+  return chunk_ptr->data;
+}
+
+// **************************************************************************
+// return the block to the string arena
+static void arena_free(void *ptr)
+{
+  struct chunk          *chunk_ptr;
+  size_t                i;
+
+  // find the header of the block
+  chunk_ptr = (struct chunk *)((char *)ptr - offsetof(struct chunk, data));
+
+  // return the block to the pool of its size class
+  for (i = 0; i < XBUS_ARENA_CLASSES; i++) {
+    if (arena_pools[i].size == chunk_ptr->size) {
+      pool_free(&arena_pools[i], chunk_ptr);
+      return;
+    }
   }
 
-  // free allocated memory
-  if (this_ptr->name) {
-    free(this_ptr->name);
+  // free a too large block
+  discharge_memory(chunk_ptr->size);
+  free(chunk_ptr);
+}
+
+// **************************************************************************
+// copy the string to the string arena
+static char *arena_strndup(const char *str, size_t length)
+{
+  char                  *ptr;
+
+  // create a copy of the string
+  ptr = (char *)arena_alloc(length + 1);
+  memcpy(ptr, str, length);
+  ptr[length] = '\0';
+
+  // return a pointer to the copy of the string
+  return ptr;
+}
+
+// **************************************************************************
+// find the index of the name in the array of names
+static int find_name(const char **names, const char *name)
+{
+  int                   i;
+
+  // search the array
+  for (i = 0; names[i]; i++) {
+    if (!strcmp(names[i], name)) {
+      return i;
+    }
   }
-  free(this_ptr);
+
+  // return an invalid index if the name was not found
+  return -1;
+}
+
+// **************************************************************************
+// find the value of the option in the list of options "name=value" separated by spaces (the list ends at the end
+// of the first line)
+static const char *find_option(const char *options, const char *name)
+{
+  size_t                length;
+
+  // check all options
+  length = strlen(name);
+  while (*(options += strspn(options, " ")) && *options != '\n') {
+    if (!strncmp(options, name, length) && options[length] == '=') {
+      return options + length + 1;
+    }
+    options += strcspn(options, " \n");
+  }
+
+  // the option was not found
+  return NULL;
+}
+
+// **************************************************************************
+// open a UNIX socket
+static int open_unix_socket(const char *path)
+{
+  struct sockaddr_un    addr;
+  int                   sk;
+
+  // create a new socket
+  if ((sk = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+    syslog(LOG_CRIT, "create socket error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // bind the socket to the path
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(addr.sun_path);
+  if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    syslog(LOG_CRIT, "bind socket error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // initialize listening for connection requests
+  if (listen(sk, SOMAXCONN) != 0) {
+    syslog(LOG_CRIT, "listen on socket error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // return the assigned socket descriptor
+  return sk;
+}
+
+// **************************************************************************
+// refuse a pending connection when descriptors run out (the spare descriptor is released to accept and close
+// the connection, otherwise the listening socket would stay readable and the main loop would spin)
+static void refuse_client(int sk_listen)
+{
+  int                   sk;
+
+  // write information to the log once until a connection is accepted again
+  if (!refusing) {
+    syslog(LOG_WARNING, "too many open files, connections are refused");
+    refusing = 1;
+  }
+
+  // accept and close the connection
+  if (spare_fd >= 0) {
+    close(spare_fd);
+  }
+  if ((sk = accept4(sk_listen, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+    close(sk);
+  }
+  spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+// **************************************************************************
+// find process name for the client
+static const char *get_name(struct client *client_ptr)
+{
+  ssize_t               size;
+  char                  name[64];
+  char                  *ptr;
+  int                   fd;
+
+  // return the process name if already found
+  if (client_ptr->name) {
+    return client_ptr->name;
+  }
+
+  // stop if the PID of the client is unknown
+  if (client_ptr->cred.pid <= 0) {
+    return "?";
+  }
+
+  // read process information
+  snprintf(name, sizeof(name), "/proc/%d/status", client_ptr->cred.pid);
+  if ((fd = open(name, O_RDONLY)) < 0) {
+    return "?";
+  }
+  size = read(fd, name, sizeof(name) - 1);
+  name[size > 0 ? size : 0] = '\0';
+  close(fd);
+
+  // find process name
+  strtok(name, "\t");
+  if (!(ptr = strtok(NULL, "\n"))) {
+    return "?";
+  }
+
+  // save and return the found process name
+  return client_ptr->name = arena_strndup(ptr, strlen(ptr));
+}
+
+// **************************************************************************
+// check whether the memory budget allows the client to allocate the given amount of memory
+static int check_budget(struct client *client_ptr, size_t size)
+{
+  size_t                reserved;
+  size_t                used;
+
+  // an unlimited budget allows everything
+  if (!memory_limit) {
+    return 1;
+  }
+
+  // get the amount of memory taken from the system (free chunks of slabs count too because slabs are returned only
+  // when they are empty)
+  pthread_mutex_lock(&memory_mutex);
+  reserved = memory_reserved;
+  used     = memory_used;
+  pthread_mutex_unlock(&memory_mutex);
+
+  // the budget allows the allocation
+  if (reserved + size <= memory_limit) {
+    if (memory_exhausted) {
+      syslog(LOG_NOTICE, "memory budget is available again");
+      memory_exhausted = 0;
+    }
+    return 1;
+  }
+
+  // write information to the log only once until the budget becomes available again
+  if (!memory_exhausted) {
+    syslog(LOG_WARNING, "memory budget exhausted (%zu of %zu bytes reserved, %zu used), rejecting requests of process %s "
+           "and others", reserved, memory_limit, used, get_name(client_ptr));
+    memory_exhausted = 1;
+  }
+
+  // reject the request
+  client_ptr->rejected++;
+  return 0;
 }
 
 // **************************************************************************
@@ -289,321 +1204,5415 @@ static int match_topic(const char *topic, const char *regex)
 }
 
 // **************************************************************************
-// store a received message
-static void store_message(const char *topic, const char *payload)
+// create a payload filter from its description "prefix:<text>", "equal:<text>" or "<key><operator><number>"
+// with one of operators <, <=, >, >=, == and != (returns NULL if the description is invalid)
+static struct filter *create_filter(const char *text, size_t length)
+{
+  struct filter         *this_ptr;
+  const char            *ptr;
+  char                  operator[3];
+  char                  *end;
+  double                number;
+  size_t                size;
+  int                   type;
+
+  // compare the payload with the text
+  if (length >= 7 && !strncmp(text, "prefix:", 7)) {
+    type    = FILTER_PREFIX;
+    text   += 7;
+    length -= 7;
+    number  = 0;
+  } else if (length >= 6 && !strncmp(text, "equal:", 6)) {
+    type    = FILTER_EQUAL;
+    text   += 6;
+    length -= 6;
+    number  = 0;
+  } else {
+
+    // split the description to the key, the operator and the number
+    for (ptr = text; ptr < text + length && !strchr("<>=!", *ptr); ptr++)
+      ;
+    size = strspn(ptr, "<>=!");
+    if (ptr == text || !size || size > 2 || ptr + size >= text + length) {
+      return NULL;
+    }
+    memcpy(operator, ptr, size);
+    operator[size] = '\0';
+
+    // translate the operator and convert the number (it must end the description)
+    number = strtod(ptr + size, &end);
+    if ((type = find_name(operator_names, operator)) < 0 || end != text + length) {
+      return NULL;
+    }
+    type  += FILTER_LESS;
+    length = ptr - text;
+  }
+
+  // create a new record
+  this_ptr = (struct filter *)arena_alloc(sizeof(*this_ptr) + length + 1);
+
+  // set the content of the new record
+  this_ptr->type   = type;
+  this_ptr->number = number;
+  this_ptr->length = length;
+  memcpy(this_ptr->text, text, length);
+  this_ptr->text[length] = '\0';
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// evaluate the payload filter on the payload (empty payloads of deleted or expired messages always pass)
+static int match_filter(const struct filter *filter_ptr, const char *payload, size_t size)
+{
+  const char            *ptr;
+  char                  *end;
+  double                number;
+
+  // pass empty payloads
+  if (!size) {
+    return 1;
+  }
+
+  // compare the payload with the text
+  switch (filter_ptr->type) {
+    case FILTER_PREFIX:
+      return size >= filter_ptr->length && !memcmp(payload, filter_ptr->text, filter_ptr->length);
+    case FILTER_EQUAL:
+      return size == filter_ptr->length && !memcmp(payload, filter_ptr->text, filter_ptr->length);
+  }
+
+  // find the field with the key at the beginning of the payload or after a separator
+  for (ptr = payload; (ptr = memmem(ptr, payload + size - ptr, filter_ptr->text, filter_ptr->length)); ptr++) {
+    if ((ptr == payload || strchr(" \t\r\n,;&", ptr[-1])) && ptr[filter_ptr->length] == '=') {
+      break;
+    }
+  }
+
+  // convert the value of the field (the payload is always terminated by a null character)
+  if (!ptr || (number = strtod(ptr + filter_ptr->length + 1, &end), end == ptr + filter_ptr->length + 1)) {
+    return 0;
+  }
+
+  // compare the value with the number
+  switch (filter_ptr->type) {
+    case FILTER_LESS:
+      return number < filter_ptr->number;
+    case FILTER_LESS_EQUAL:
+      return number <= filter_ptr->number;
+    case FILTER_GREATER:
+      return number > filter_ptr->number;
+    case FILTER_GREATER_EQUAL:
+      return number >= filter_ptr->number;
+    case FILTER_NUMBER_EQUAL:
+      return number == filter_ptr->number;
+    default:
+      return number != filter_ptr->number;
+  }
+}
+
+// **************************************************************************
+// calculate the hash of a topic segment
+static unsigned int hash_segment(const struct index_node *parent_ptr, const char *segment, size_t length)
+{
+  unsigned int          hash;
+
+  // calculate FNV-1a hash of the segment seeded by the parent node
+  hash = 2166136261u ^ (unsigned int)((size_t)parent_ptr >> 4);
+  while (length--) {
+    hash = (hash ^ (unsigned char)*segment++) * 16777619u;
+  }
+
+  // return the calculated hash
+  return hash;
+}
+
+// **************************************************************************
+// resize the hash table of literal nodes
+static void resize_index_table(size_t size)
+{
+  struct index_node     **table;
+  struct index_node     *this_ptr;
+  struct index_node     *next_ptr;
+  size_t                i;
+
+  // create a new empty table
+  table = (struct index_node **)safe_alloc(size * sizeof(*table));
+  memset(table, 0, size * sizeof(*table));
+
+  // move all nodes to the new table
+  for (i = 0; i < index_table_size; i++) {
+    for (this_ptr = index_table[i]; this_ptr; this_ptr = next_ptr) {
+      next_ptr = this_ptr->next_ptr;
+      this_ptr->next_ptr = table[this_ptr->hash & (size - 1)];
+      table[this_ptr->hash & (size - 1)] = this_ptr;
+    }
+  }
+
+  // replace the old table
+  free(index_table);
+  index_table      = table;
+  index_table_size = size;
+}
+
+// **************************************************************************
+// find a literal child node of the subscription index
+static struct index_node *find_literal_node(struct index_node *parent_ptr, const char *segment, size_t length)
+{
+  struct index_node     *this_ptr;
+  unsigned int          hash;
+
+  // stop if the hash table is empty
+  if (!index_table_count) {
+    return NULL;
+  }
+
+  // find a node in the hash table
+  hash = hash_segment(parent_ptr, segment, length);
+  for (this_ptr = index_table[hash & (index_table_size - 1)]; this_ptr; this_ptr = this_ptr->next_ptr) {
+    if (this_ptr->hash == hash && this_ptr->parent_ptr == parent_ptr &&
+        this_ptr->length == length && !memcmp(this_ptr->segment, segment, length)) {
+      break;
+    }
+  }
+
+  // return a pointer to the found node
+  return this_ptr;
+}
+
+// **************************************************************************
+// find or create a child node of the subscription index
+static struct index_node *get_index_node(struct index_node *parent_ptr, int type, const char *segment, size_t length)
+{
+  struct index_node     **list_ptr;
+  struct index_node     *this_ptr;
+
+  // find an existing node
+  if (type == NODE_LITERAL) {
+    if ((this_ptr = find_literal_node(parent_ptr, segment, length))) {
+      return this_ptr;
+    }
+    list_ptr = NULL;
+  } else {
+    list_ptr = type == NODE_PLUS ? &parent_ptr->plus_ptr : &parent_ptr->star_ptr;
+    for (this_ptr = *list_ptr; this_ptr; this_ptr = this_ptr->next_ptr) {
+      if (this_ptr->length == length && !memcmp(this_ptr->segment, segment, length)) {
+        return this_ptr;
+      }
+    }
+  }
+
+  // create a new record
+  this_ptr = (struct index_node *)pool_alloc(&index_pool);
+
+  // set the content of the new record
+  this_ptr->type          = type;
+  this_ptr->segment       = arena_strndup(segment, length);
+  this_ptr->length        = length;
+  this_ptr->hash          = hash_segment(parent_ptr, segment, length);
+  this_ptr->count         = 0;
+  this_ptr->parent_ptr    = parent_ptr;
+  this_ptr->plus_ptr      = NULL;
+  this_ptr->star_ptr      = NULL;
+  this_ptr->subscribe_ptr = NULL;
+
+  // add the new record to the hash table or to the list of wildcard nodes
+  if (list_ptr) {
+    this_ptr->next_ptr = *list_ptr;
+    *list_ptr          = this_ptr;
+  } else {
+    if (index_table_count >= index_table_size) {
+      resize_index_table(index_table_size ? 2 * index_table_size : XBUS_HASH_SIZE);
+    }
+    this_ptr->next_ptr = index_table[this_ptr->hash & (index_table_size - 1)];
+    index_table[this_ptr->hash & (index_table_size - 1)] = this_ptr;
+    index_table_count++;
+  }
+
+  // update the number of references to the parent node
+  parent_ptr->count++;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// destroy unused nodes of the subscription index
+static void release_index_node(struct index_node *this_ptr)
+{
+  struct index_node     *parent_ptr;
+  struct index_node     **list_ptr;
+
+  // traverse the nodes up to the root
+  while (this_ptr != &index_root && !this_ptr->count) {
+
+    // remove the node from the hash table or from the list of wildcard nodes
+    parent_ptr = this_ptr->parent_ptr;
+    if (this_ptr->type == NODE_LITERAL) {
+      list_ptr = &index_table[this_ptr->hash & (index_table_size - 1)];
+      index_table_count--;
+    } else {
+      list_ptr = this_ptr->type == NODE_PLUS ? &parent_ptr->plus_ptr : &parent_ptr->star_ptr;
+    }
+    while (*list_ptr != this_ptr) {
+      list_ptr = &(*list_ptr)->next_ptr;
+    }
+    *list_ptr = this_ptr->next_ptr;
+
+    // free allocated memory
+    arena_free(this_ptr->segment);
+    pool_free(&index_pool, this_ptr);
+
+    // continue with the parent node
+    parent_ptr->count--;
+    this_ptr = parent_ptr;
+  }
+}
+
+// **************************************************************************
+// resize the hash table of interned topics
+static void resize_topic_table(size_t size)
+{
+  struct topic          **table;
+  struct topic          *this_ptr;
+  struct topic          *next_ptr;
+  size_t                i;
+
+  // create a new empty table
+  table = (struct topic **)safe_alloc(size * sizeof(*table));
+  memset(table, 0, size * sizeof(*table));
+
+  // move all topics to the new table
+  for (i = 0; i < topic_table_size; i++) {
+    for (this_ptr = topic_table[i]; this_ptr; this_ptr = next_ptr) {
+      next_ptr = this_ptr->next_ptr;
+      this_ptr->next_ptr = table[this_ptr->hash & (size - 1)];
+      table[this_ptr->hash & (size - 1)] = this_ptr;
+    }
+  }
+
+  // replace the old table
+  free(topic_table);
+  topic_table      = table;
+  topic_table_size = size;
+}
+
+// **************************************************************************
+// find an interned topic
+static struct topic *find_topic(const char *name)
+{
+  struct topic          *this_ptr;
+  unsigned int          hash;
+  size_t                length;
+
+  // stop if the hash table is empty
+  if (!topic_table_count) {
+    return NULL;
+  }
+
+  // find a topic in the hash table
+  length = strlen(name);
+  hash   = hash_segment(NULL, name, length);
+  for (this_ptr = topic_table[hash & (topic_table_size - 1)]; this_ptr; this_ptr = this_ptr->next_ptr) {
+    if (this_ptr->hash == hash && this_ptr->length == length && !memcmp(this_ptr->name, name, length)) {
+      break;
+    }
+  }
+
+  // return a pointer to the found topic
+  return this_ptr;
+}
+
+// **************************************************************************
+// intern the topic and add a reference to it
+static struct topic *intern_topic(const char *name)
+{
+  struct topic          *this_ptr;
+  size_t                length;
+
+  // add a reference to an existing record if was found
+  if ((this_ptr = find_topic(name))) {
+    this_ptr->refs++;
+    return this_ptr;
+  }
+
+  // create a new record
+  length   = strlen(name);
+  this_ptr = (struct topic *)arena_alloc(sizeof(*this_ptr) + length + 1);
+
+  // set the content of the new record
+  this_ptr->hash        = hash_segment(NULL, name, length);
+  this_ptr->refs        = 1;
+  this_ptr->id          = ++topic_last_id;
+  this_ptr->length      = length;
+  this_ptr->message_ptr = NULL;
+  this_ptr->cache_ptr   = NULL;
+  memcpy(this_ptr->name, name, length + 1);
+
+  // add the new record to the hash table
+  if (topic_table_count >= topic_table_size) {
+    resize_topic_table(topic_table_size ? 2 * topic_table_size : XBUS_HASH_SIZE);
+  }
+  this_ptr->next_ptr = topic_table[this_ptr->hash & (topic_table_size - 1)];
+  topic_table[this_ptr->hash & (topic_table_size - 1)] = this_ptr;
+  topic_table_count++;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// remove a reference to the interned topic
+static void release_topic(struct topic *this_ptr)
+{
+  struct topic          **list_ptr;
+
+  // stop if the topic is still referenced
+  if (--this_ptr->refs) {
+    return;
+  }
+
+  // remove the record from the hash table
+  list_ptr = &topic_table[this_ptr->hash & (topic_table_size - 1)];
+  while (*list_ptr != this_ptr) {
+    list_ptr = &(*list_ptr)->next_ptr;
+  }
+  *list_ptr = this_ptr->next_ptr;
+  topic_table_count--;
+
+  // free allocated memory
+  if (this_ptr->cache_ptr) {
+    arena_free(this_ptr->cache_ptr);
+  }
+  arena_free(this_ptr);
+}
+
+// **************************************************************************
+// find the position of the alias in the sorted array of aliases registered by the client
+static size_t find_alias_index(struct client *client_ptr, unsigned int alias)
+{
+  size_t                low;
+  size_t                high;
+  size_t                mid;
+
+  // use binary search
+  low  = 0;
+  high = client_ptr->alias_count;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (client_ptr->aliases[mid]->id < alias) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // return the index of the alias or the position where it should be inserted
+  return low;
+}
+
+// **************************************************************************
+// find the topic of the alias registered by the client
+static struct topic *find_alias(struct client *client_ptr, unsigned int alias)
+{
+  size_t                index;
+
+  // find the alias in the array
+  index = find_alias_index(client_ptr, alias);
+
+  // return a pointer to the topic
+  return index < client_ptr->alias_count && client_ptr->aliases[index]->id == alias ? client_ptr->aliases[index] : NULL;
+}
+
+// **************************************************************************
+// get the current time of the clock in milliseconds
+static uint64_t get_time(clockid_t clock)
+{
+  struct timespec       ts;
+
+  // read the clock
+  clock_gettime(clock, &ts);
+
+  // return the time in milliseconds
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// **************************************************************************
+// schedule the timer to the given expiration time
+static void add_timer(struct timer *timer_ptr, uint64_t expires)
+{
+  struct timer          **list_ptr;
+  uint64_t              tick;
+  uint64_t              delta;
+  int                   level;
+
+  // find the tick of the expiration (rounded up, so that timers do not expire early)
+  timer_ptr->expires = expires;
+  tick = (expires + XBUS_TICK - 1) / XBUS_TICK;
+  if (tick < timer_tick) {
+    tick = timer_tick;
+  }
+
+  // choose the level according to the remaining number of ticks (too distant timers are put to the last slot
+  // of the highest level and they are added again once it is cascaded)
+  delta = tick - timer_tick;
+  for (level = 0; level < XBUS_WHEEL_LEVELS - 1 && delta >> ((level + 1) * XBUS_WHEEL_BITS); level++)
+    ;
+  if (delta >> (XBUS_WHEEL_LEVELS * XBUS_WHEEL_BITS)) {
+    tick = timer_tick + ((uint64_t)1 << (XBUS_WHEEL_LEVELS * XBUS_WHEEL_BITS)) - 1;
+  }
+
+  // add the timer to the beginning of the list of the slot
+  list_ptr = &timer_wheel[level][(tick >> (level * XBUS_WHEEL_BITS)) & ((1 << XBUS_WHEEL_BITS) - 1)];
+  timer_ptr->next_ptr = *list_ptr;
+  timer_ptr->link_ptr = list_ptr;
+  if (*list_ptr) {
+    (*list_ptr)->link_ptr = &timer_ptr->next_ptr;
+  }
+  *list_ptr = timer_ptr;
+  timer_count++;
+}
+
+// **************************************************************************
+// cancel the scheduled timer
+static void remove_timer(struct timer *timer_ptr)
+{
+  // unlink the timer from the list of its slot
+  *timer_ptr->link_ptr = timer_ptr->next_ptr;
+  if (timer_ptr->next_ptr) {
+    timer_ptr->next_ptr->link_ptr = timer_ptr->link_ptr;
+  }
+  timer_ptr->expires = 0;
+  timer_count--;
+}
+
+// **************************************************************************
+// find the time in milliseconds until the timer wheel must be advanced (-1 if it is empty)
+static int get_timer_timeout(void)
+{
+  uint64_t              now;
+  uint64_t              tick;
+  uint64_t              end;
+
+  // wait without a limit if no timer is scheduled
+  if (!timer_count) {
+    return -1;
+  }
+
+  // find the first occupied slot of the lowest level before the level wraps around and higher levels are cascaded
+  end = (timer_tick | ((1 << XBUS_WHEEL_BITS) - 1)) + 1;
+  for (tick = timer_tick; tick < end && !timer_wheel[0][tick & ((1 << XBUS_WHEEL_BITS) - 1)]; tick++)
+    ;
+
+  // return the remaining time of the tick
+  now = get_time(CLOCK_MONOTONIC);
+  return tick * XBUS_TICK > now ? (int)(tick * XBUS_TICK - now) : 0;
+}
+
+// **************************************************************************
+// add the subscription to the subscription index
+static void index_subscription(struct subscribe *subscribe_ptr)
+{
+  struct index_node     *node_ptr;
+  struct subscribe      **list_ptr;
+  const char            *segment;
+  const char            *end;
+  const char            *wildcard;
+
+  // traverse all levels of the topic pattern
+  node_ptr = &index_root;
+  segment  = subscribe_ptr->topic_ptr->name;
+  while (1) {
+
+    // find the end of the level and the first wildcard
+    end      = strchrnul(segment, '/');
+    wildcard = segment;
+    while (wildcard < end && *wildcard != '+' && *wildcard != '*') {
+      wildcard++;
+    }
+
+    // descend to the node for the level
+    if (wildcard == end) {
+      node_ptr = get_index_node(node_ptr, NODE_LITERAL, segment, end - segment);
+    } else if (*wildcard == '*') {
+      node_ptr = get_index_node(node_ptr, NODE_STAR, segment, wildcard - segment);
+      break;
+    } else if (wildcard + 1 == end) {
+      node_ptr = get_index_node(node_ptr, NODE_PLUS, segment, wildcard - segment);
+    } else {
+      release_index_node(node_ptr);
+      node_ptr = NULL;
+      break;
+    }
+
+    // stop at the last level
+    if (!*end) {
+      break;
+    }
+    segment = end + 1;
+  }
+
+  // add the subscription to the node or to the list of irregular subscriptions
+  list_ptr = node_ptr ? &node_ptr->subscribe_ptr : &fallback_ptr;
+  subscribe_ptr->node_ptr       = node_ptr;
+  subscribe_ptr->index_prev_ptr = NULL;
+  subscribe_ptr->index_next_ptr = *list_ptr;
+  if (*list_ptr) {
+    (*list_ptr)->index_prev_ptr = subscribe_ptr;
+  }
+  *list_ptr = subscribe_ptr;
+  if (node_ptr) {
+    node_ptr->count++;
+  }
+  cache_generation++;
+}
+
+// **************************************************************************
+// remove the subscription from the subscription index
+static void unindex_subscription(struct subscribe *subscribe_ptr)
+{
+  struct index_node     *node_ptr;
+
+  // remove the subscription from the list
+  node_ptr = subscribe_ptr->node_ptr;
+  if (subscribe_ptr->index_prev_ptr) {
+    subscribe_ptr->index_prev_ptr->index_next_ptr = subscribe_ptr->index_next_ptr;
+  } else if (node_ptr) {
+    node_ptr->subscribe_ptr = subscribe_ptr->index_next_ptr;
+  } else {
+    fallback_ptr = subscribe_ptr->index_next_ptr;
+  }
+  if (subscribe_ptr->index_next_ptr) {
+    subscribe_ptr->index_next_ptr->index_prev_ptr = subscribe_ptr->index_prev_ptr;
+  }
+
+  // destroy unused nodes
+  if (node_ptr) {
+    node_ptr->count--;
+    release_index_node(node_ptr);
+  }
+  cache_generation++;
+}
+
+// **************************************************************************
+// add the subscriber to the array of recipients unless it is already there (the shortest interval between messages
+// of all matching subscriptions of the client applies)
+static void add_recipient(struct subscribe *subscribe_ptr, void *arg)
+{
+  const struct packet   *packet_ptr;
+  struct client         *client_ptr;
+
+  // get the dispatched packet
+  packet_ptr = (const struct packet *)arg;
+
+  // skip the subscription if the payload does not pass its filter
+  if (subscribe_ptr->filter_ptr && !match_filter(subscribe_ptr->filter_ptr, packet_ptr->payload, packet_ptr->payload_size)) {
+    return;
+  }
+
+  // stop if the client is already a recipient of the dispatched message
+  client_ptr = subscribe_ptr->client_ptr;
+  if (client_ptr->mark == dispatch_mark) {
+    if (client_ptr->interval > subscribe_ptr->interval) {
+      client_ptr->interval = subscribe_ptr->interval;
+    }
+    return;
+  }
+  client_ptr->mark     = dispatch_mark;
+  client_ptr->interval = subscribe_ptr->interval;
+
+  // enlarge the array if necessary
+  if (recipients_count >= recipients_size) {
+    recipients_size = recipients_size ? 2 * recipients_size : 64;
+    recipients = (struct client **)safe_realloc(recipients, recipients_size * sizeof(*recipients));
+  }
+
+  // append the client to the array
+  recipients[recipients_count++] = client_ptr;
+}
+
+// **************************************************************************
+// call the function for all subscriptions in the subtree of the subscription index matching the topic
+static void visit_index_matches(struct index_node *node_ptr, const char *segment, void (*visit)(struct subscribe *, void *),
+                                void *arg)
+{
+  struct index_node     *this_ptr;
+  struct subscribe      *subscribe_ptr;
+  const char            *end;
+  size_t                length;
+
+  // add subscribers of wildcard '*' nodes with matching prefix
+  for (this_ptr = node_ptr->star_ptr; this_ptr; this_ptr = this_ptr->next_ptr) {
+    if (!strncmp(segment, this_ptr->segment, this_ptr->length)) {
+      for (subscribe_ptr = this_ptr->subscribe_ptr; subscribe_ptr; subscribe_ptr = subscribe_ptr->index_next_ptr) {
+        visit(subscribe_ptr, arg);
+      }
+    }
+  }
+
+  // find the end of the level
+  end    = strchrnul(segment, '/');
+  length = end - segment;
+
+  // process the literal node followed by all wildcard '+' nodes with matching prefix
+  this_ptr = find_literal_node(node_ptr, segment, length);
+  if (!this_ptr) {
+    this_ptr = node_ptr->plus_ptr;
+  }
+  while (this_ptr) {
+    if (this_ptr->type == NODE_LITERAL || (this_ptr->length <= length && !memcmp(this_ptr->segment, segment, this_ptr->length))) {
+      if (*end) {
+        visit_index_matches(this_ptr, end + 1, visit, arg);
+      } else {
+        for (subscribe_ptr = this_ptr->subscribe_ptr; subscribe_ptr; subscribe_ptr = subscribe_ptr->index_next_ptr) {
+          visit(subscribe_ptr, arg);
+        }
+      }
+    }
+    this_ptr = this_ptr->type == NODE_LITERAL ? node_ptr->plus_ptr : this_ptr->next_ptr;
+  }
+}
+
+// **************************************************************************
+// call the function for all subscriptions matching the topic
+static void visit_subscriptions(const char *topic, void (*visit)(struct subscribe *, void *), void *arg)
+{
+  struct subscribe      *this_ptr;
+
+  // visit subscriptions in the subscription index
+  visit_index_matches(&index_root, topic, visit, arg);
+
+  // check irregular subscriptions
+  for (this_ptr = fallback_ptr; this_ptr; this_ptr = this_ptr->index_next_ptr) {
+    if (match_topic(topic, this_ptr->topic_ptr->name)) {
+      visit(this_ptr, arg);
+    }
+  }
+}
+
+// **************************************************************************
+// find all clients who have subscribed to the topic with filters passing the packet
+static void find_recipients(const char *topic, const struct packet *packet_ptr)
+{
+  // start a new set of recipients
+  recipients_count = 0;
+  dispatch_mark++;
+
+  // find recipients among matching subscriptions
+  visit_subscriptions(topic, add_recipient, (void *)packet_ptr);
+}
+
+// **************************************************************************
+// add the subscription to the array of collected subscriptions
+static void collect_subscription(struct subscribe *subscribe_ptr, void *arg)
+{
+  (void)arg;
+
+  // enlarge the array if necessary
+  if (collected_count >= collected_size) {
+    collected_size = collected_size ? 2 * collected_size : 64;
+    collected = (struct subscribe **)safe_realloc(collected, collected_size * sizeof(*collected));
+  }
+
+  // append the subscription to the array
+  collected[collected_count++] = subscribe_ptr;
+}
+
+// **************************************************************************
+// find all clients who have subscribed to the topic published by an alias with filters passing the packet (matching
+// subscriptions are cached on the interned topic, clients who have registered the alias are marked)
+static void find_cached_recipients(struct topic *topic_ptr, const struct packet *packet_ptr)
+{
+  struct recipient_cache *cache_ptr;
+  size_t                i;
+
+  // rebuild the cache if subscriptions or aliases have changed
+  cache_ptr = topic_ptr->cache_ptr;
+  if (!cache_ptr || cache_ptr->generation != cache_generation) {
+    if (cache_ptr) {
+      arena_free(cache_ptr);
+    }
+    collected_count = 0;
+    visit_subscriptions(topic_ptr->name, collect_subscription, NULL);
+    cache_ptr = (struct recipient_cache *)arena_alloc(sizeof(*cache_ptr) + collected_count * sizeof(cache_ptr->entries[0]));
+    cache_ptr->generation = cache_generation;
+    cache_ptr->count      = collected_count;
+    for (i = 0; i < collected_count; i++) {
+      cache_ptr->entries[i].subscribe_ptr = collected[i];
+      cache_ptr->entries[i].aliased       = find_alias(collected[i]->client_ptr, topic_ptr->id) != NULL;
+    }
+    topic_ptr->cache_ptr = cache_ptr;
+  }
+
+  // start a new set of recipients
+  recipients_count = 0;
+  dispatch_mark++;
+
+  // add recipients from the cache
+  for (i = 0; i < cache_ptr->count; i++) {
+    add_recipient(cache_ptr->entries[i].subscribe_ptr, (void *)packet_ptr);
+    if (cache_ptr->entries[i].aliased) {
+      cache_ptr->entries[i].subscribe_ptr->client_ptr->alias_mark = dispatch_mark;
+    }
+  }
+}
+
+// **************************************************************************
+// create a packet
+static struct packet *create_packet(const char *topic, const char *payload, size_t payload_size)
+{
+  struct packet         *this_ptr;
+  size_t                topic_size;
+
+  // get length of the topic
+  topic_size = strlen(topic);
+
+  // create a new record
+  this_ptr = (struct packet *)arena_alloc(sizeof(*this_ptr) + topic_size + payload_size + 2);
+
+  // set the content of the new record
+  this_ptr->refs         = 1;
+  this_ptr->size         = topic_size + payload_size + 2;
+  this_ptr->topic_size   = topic_size;
+  this_ptr->payload_size = payload_size;
+  this_ptr->payload      = this_ptr->data + topic_size + 1;
+  this_ptr->fd           = -1;
+  this_ptr->origin_ptr   = NULL;
+  memcpy(this_ptr->data, topic, topic_size);
+  this_ptr->data[topic_size] = '\n';
+  memcpy(this_ptr->payload, payload, payload_size);
+  this_ptr->payload[payload_size] = '\0';
+
+  // prepare the header of the binary form of the packet
+  this_ptr->header.marker       = 0;
+  this_ptr->header.opcode       = OP_MESSAGE;
+  this_ptr->header.flags        = 0;
+  this_ptr->header.topic_size   = topic_size;
+  this_ptr->header.payload_size = payload_size;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// create a packet whose payload is mapped from the memory file
+static struct packet *create_memfd_packet(const char *topic, char *payload, size_t payload_size, int fd)
+{
+  struct packet         *this_ptr;
+  size_t                topic_size;
+
+  // get length of the topic
+  topic_size = strlen(topic);
+
+  // create a new record (the packet takes over the mapping and the descriptor, the mapping is charged to the budget)
+  this_ptr = (struct packet *)arena_alloc(sizeof(*this_ptr) + topic_size + 1);
+  charge_memory(payload_size + 1);
+
+  // set the content of the new record
+  this_ptr->refs         = 1;
+  this_ptr->size         = topic_size + payload_size + 2;
+  this_ptr->topic_size   = topic_size;
+  this_ptr->payload_size = payload_size;
+  this_ptr->payload      = payload;
+  this_ptr->fd           = fd;
+  this_ptr->origin_ptr   = NULL;
+  memcpy(this_ptr->data, topic, topic_size);
+  this_ptr->data[topic_size] = '\n';
+
+  // prepare the header of the binary form of the packet
+  this_ptr->header.marker       = 0;
+  this_ptr->header.opcode       = OP_MESSAGE;
+  this_ptr->header.flags        = 0;
+  this_ptr->header.topic_size   = topic_size;
+  this_ptr->header.payload_size = payload_size;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// add a reference to the packet
+static struct packet *hold_packet(struct packet *packet_ptr)
+{
+  // increment the reference counter (packets are shared with sending threads)
+  __atomic_add_fetch(&packet_ptr->refs, 1, __ATOMIC_RELAXED);
+
+  // return a pointer to the packet
+  return packet_ptr;
+}
+
+// **************************************************************************
+// remove a reference to the packet
+static void release_packet(struct packet *packet_ptr)
+{
+  struct packet         *origin_ptr;
+
+  // free the packet if it is no longer referenced
+  if (!__atomic_sub_fetch(&packet_ptr->refs, 1, __ATOMIC_ACQ_REL)) {
+    if (packet_ptr->fd >= 0) {
+      munmap(packet_ptr->payload, packet_ptr->payload_size + 1);
+      close(packet_ptr->fd);
+      discharge_memory(packet_ptr->payload_size + 1);
+    }
+    origin_ptr = packet_ptr->origin_ptr;
+    arena_free(packet_ptr);
+    if (origin_ptr) {
+      release_packet(origin_ptr);
+    }
+  }
+}
+
+// **************************************************************************
+// create a packet with the alias of the topic which shares the payload of the original packet
+static struct packet *create_alias_packet(struct packet *origin_ptr, unsigned int alias)
+{
+  struct packet         *this_ptr;
+
+  // create a new record
+  this_ptr = (struct packet *)arena_alloc(sizeof(*this_ptr) + 1);
+
+  // set the content of the new record (the packet holds a reference to the original packet)
+  this_ptr->refs         = 1;
+  this_ptr->size         = origin_ptr->payload_size + 2;
+  this_ptr->topic_size   = 0;
+  this_ptr->payload_size = origin_ptr->payload_size;
+  this_ptr->payload      = origin_ptr->payload;
+  this_ptr->fd           = -1;
+  this_ptr->origin_ptr   = hold_packet(origin_ptr);
+  this_ptr->data[0]      = '\n';
+
+  // prepare the header of the binary form of the packet (the alias takes the place of the topic size)
+  this_ptr->header.marker       = 0;
+  this_ptr->header.opcode       = OP_MESSAGE;
+  this_ptr->header.flags        = origin_ptr->header.flags | FLAG_ALIAS;
+  this_ptr->header.topic_size   = alias;
+  this_ptr->header.payload_size = origin_ptr->payload_size;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// create a reply to the request with the correlation identifier which shares the payload of the original packet
+// (the identifier and a space precede the topic)
+static struct packet *create_reply_packet(struct packet *origin_ptr, unsigned long id, int flags)
+{
+  struct packet         *this_ptr;
+  char                  prefix[24];
+  size_t                length;
+
+  // format the identifier
+  length = snprintf(prefix, sizeof(prefix), "%lu ", id);
+
+  // create a new record
+  this_ptr = (struct packet *)arena_alloc(sizeof(*this_ptr) + length + origin_ptr->topic_size + 1);
+
+  // set the content of the new record (the packet holds a reference to the original packet)
+  this_ptr->refs         = 1;
+  this_ptr->size         = length + origin_ptr->topic_size + origin_ptr->payload_size + 2;
+  this_ptr->topic_size   = length + origin_ptr->topic_size;
+  this_ptr->payload_size = origin_ptr->payload_size;
+  this_ptr->payload      = origin_ptr->payload;
+  this_ptr->fd           = -1;
+  this_ptr->origin_ptr   = hold_packet(origin_ptr);
+  memcpy(this_ptr->data, prefix, length);
+  memcpy(this_ptr->data + length, origin_ptr->data, origin_ptr->topic_size);
+  this_ptr->data[this_ptr->topic_size] = '\n';
+
+  // prepare the header of the binary form of the packet
+  this_ptr->header.marker       = 0;
+  this_ptr->header.opcode       = OP_REPLY;
+  this_ptr->header.flags        = flags;
+  this_ptr->header.topic_size   = this_ptr->topic_size;
+  this_ptr->header.payload_size = this_ptr->payload_size;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// resize the hash table of conflation slots of the client
+static void resize_slot_table(struct client *client_ptr, size_t size)
+{
+  struct conflation     **table;
+  struct conflation     *this_ptr;
+  struct conflation     *next_ptr;
+  size_t                i;
+
+  // create a new empty table
+  table = (struct conflation **)safe_alloc(size * sizeof(*table));
+  memset(table, 0, size * sizeof(*table));
+
+  // move all slots to the new table
+  for (i = 0; i < client_ptr->slot_table_size; i++) {
+    for (this_ptr = client_ptr->slot_table[i]; this_ptr; this_ptr = next_ptr) {
+      next_ptr = this_ptr->next_ptr;
+      this_ptr->next_ptr = table[this_ptr->topic_ptr->hash & (size - 1)];
+      table[this_ptr->topic_ptr->hash & (size - 1)] = this_ptr;
+    }
+  }
+
+  // replace the old table
+  free(client_ptr->slot_table);
+  discharge_memory(client_ptr->slot_table_size * sizeof(*table));
+  charge_memory(size * sizeof(*table));
+  client_ptr->slot_table      = table;
+  client_ptr->slot_table_size = size;
+}
+
+// **************************************************************************
+// destroy the conflation slot (a message held back in it is discarded)
+static void remove_slot(struct conflation *this_ptr)
+{
+  struct conflation     **list_ptr;
+  struct client         *client_ptr;
+
+  // remove the slot from the hash table of the client
+  client_ptr = this_ptr->client_ptr;
+  list_ptr   = &client_ptr->slot_table[this_ptr->topic_ptr->hash & (client_ptr->slot_table_size - 1)];
+  while (*list_ptr != this_ptr) {
+    list_ptr = &(*list_ptr)->next_ptr;
+  }
+  *list_ptr = this_ptr->next_ptr;
+  client_ptr->slot_count--;
+
+  // free allocated memory
+  if (this_ptr->timer.expires) {
+    remove_timer(&this_ptr->timer);
+  }
+  if (this_ptr->packet_ptr) {
+    release_packet(this_ptr->packet_ptr);
+  }
+  release_topic(this_ptr->topic_ptr);
+  pool_free(&conflation_pool, this_ptr);
+}
+
+// **************************************************************************
+// find the conflation slot of the client for the interned topic (returns NULL if there is none)
+static struct conflation *find_slot(struct client *client_ptr, struct topic *topic_ptr)
+{
+  struct conflation     *this_ptr;
+
+  // search the list of the bucket of the hash table
+  if (!client_ptr->slot_count) {
+    return NULL;
+  }
+  for (this_ptr = client_ptr->slot_table[topic_ptr->hash & (client_ptr->slot_table_size - 1)]; this_ptr; this_ptr = this_ptr->next_ptr) {
+    if (this_ptr->topic_ptr == topic_ptr) {
+      return this_ptr;
+    }
+  }
+
+  // the slot was not found
+  return NULL;
+}
+
+// **************************************************************************
+// destroy the conflation slot of the client for the topic before a message on the topic is sent to the client
+// directly, so that an older message held back in it cannot overtake the new one
+static void discard_slot(struct client *client_ptr, const char *topic)
+{
+  struct conflation     *this_ptr;
+  struct topic          *topic_ptr;
+
+  // find the slot
+  if (!client_ptr->slot_count || !(topic_ptr = find_topic(topic)) || !(this_ptr = find_slot(client_ptr, topic_ptr))) {
+    return;
+  }
+
+  // the held message is replaced by the new one
+  if (this_ptr->packet_ptr) {
+    client_ptr->conflated++;
+  }
+  remove_slot(this_ptr);
+}
+
+// **************************************************************************
+// destroy all conflation slots of the client (messages held back in them are discarded)
+static void release_slots(struct client *client_ptr)
+{
+  size_t                i;
+
+  // destroy the slots
+  for (i = 0; i < client_ptr->slot_table_size; i++) {
+    while (client_ptr->slot_table[i]) {
+      remove_slot(client_ptr->slot_table[i]);
+    }
+  }
+
+  // free the table
+  free(client_ptr->slot_table);
+  discharge_memory(client_ptr->slot_table_size * sizeof(*client_ptr->slot_table));
+  client_ptr->slot_table      = NULL;
+  client_ptr->slot_table_size = 0;
+}
+
+// **************************************************************************
+// destroy the batch of replies (packets which have not been sent are released)
+static void free_batch(struct batch *this_ptr)
+{
+  size_t                i;
+
+  // release the packets and free the record
+  for (i = this_ptr->index; i < this_ptr->count; i++) {
+    release_packet(this_ptr->packets[i]);
+  }
+  free(this_ptr->packets);
+  free(this_ptr->data);
+  discharge_memory(sizeof(*this_ptr) + this_ptr->size * sizeof(*this_ptr->packets) + this_ptr->data_size);
+  free(this_ptr);
+}
+
+// **************************************************************************
+// destroy all batches of replies waiting for the client
+static void release_batches(struct client *client_ptr)
+{
+  struct batch          *this_ptr;
+
+  // cancel resuming of sending
+  if (client_ptr->batch_timer.expires) {
+    remove_timer(&client_ptr->batch_timer);
+  }
+
+  // destroy the batches
+  while ((this_ptr = client_ptr->batch_ptr)) {
+    client_ptr->batch_ptr = this_ptr->next_ptr;
+    free_batch(this_ptr);
+  }
+}
+
+// **************************************************************************
+// find the priority class of the client
+static int get_priority(struct client *client_ptr)
+{
+  size_t                i;
+
+  // compare the user of the client with users with high priority
+  for (i = 0; i < priority_user_count; i++) {
+    if (client_ptr->cred.uid == priority_users[i]) {
+      return PRIORITY_HIGH;
+    }
+  }
+
+  // compare the process name of the client with processes with high priority
+  for (i = 0; i < priority_process_count; i++) {
+    if (!strcmp(get_name(client_ptr), priority_processes[i])) {
+      return PRIORITY_HIGH;
+    }
+  }
+
+  // return the default priority class
+  return PRIORITY_NORMAL;
+}
+
+#ifdef XBUS_URING
+// **************************************************************************
+// submit prepared io_uring operations and wait for the given number of completions
+static void enter_uring(unsigned int wait, int timeout)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned int          flags;
+  unsigned int          count;
+
+  // publish prepared entries of the submission queue
+  __atomic_store_n(uring.sq_tail_ptr, uring.sq_tail, __ATOMIC_RELEASE);
+  count = uring.sq_tail - __atomic_load_n(uring.sq_head_ptr, __ATOMIC_ACQUIRE);
+
+  // limit the time of waiting for completions if requested
+  flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  memset(&arg, 0, sizeof(arg));
+  if (wait && timeout >= 0) {
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    arg.ts     = (uint64_t)(uintptr_t)&ts;
+    flags     |= IORING_ENTER_EXT_ARG;
+  }
+
+  // submit the entries (the kernel refuses new submissions while completions overflow)
+  if (syscall(SYS_io_uring_enter, uring.fd, count, wait, flags, flags & IORING_ENTER_EXT_ARG ? &arg : NULL, sizeof(arg)) < 0) {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME) {
+      syslog(LOG_ERR, "io_uring_enter error: %s", strerror(errno));
+    }
+  }
+}
+
+// **************************************************************************
+// make room for the given number of entries in the submission queue
+static void reserve_sqes(unsigned int count)
+{
+  // submit prepared entries until there is enough free entries
+  while (uring.sq_entries - (uring.sq_tail - __atomic_load_n(uring.sq_head_ptr, __ATOMIC_ACQUIRE)) < count) {
+    enter_uring(0, -1);
+  }
+}
+
+// **************************************************************************
+// get a cleared entry of the submission queue
+static struct io_uring_sqe *get_sqe(int tag, void *ptr)
+{
+  struct io_uring_sqe   *sqe_ptr;
+
+  // make room for the entry
+  reserve_sqes(1);
+
+  // clear the entry and identify the operation
+  sqe_ptr = &uring.sqes[uring.sq_tail++ & uring.sq_mask];
+  memset(sqe_ptr, 0, sizeof(*sqe_ptr));
+  sqe_ptr->user_data = (uintptr_t)ptr | tag;
+
+  // return a pointer to the entry
+  return sqe_ptr;
+}
+
+// **************************************************************************
+// return the provided buffer to the io_uring instance
+static void recycle_buffer(unsigned int index)
+{
+  struct io_uring_buf   *buf_ptr;
+
+  // append the buffer to the ring of provided buffers
+  buf_ptr = &uring.buffer_ring->bufs[uring.buffer_tail & (XBUS_URING_BUFFERS - 1)];
+  buf_ptr->addr = (uintptr_t)(uring.buffers + index * sizeof(struct buffer));
+  buf_ptr->len  = sizeof(struct buffer);
+  buf_ptr->bid  = index;
+  __atomic_store_n(&uring.buffer_ring->tail, ++uring.buffer_tail, __ATOMIC_RELEASE);
+}
+
+// **************************************************************************
+// accept connections by a multishot operation
+static void arm_accept(int sk_listen)
+{
+  struct io_uring_sqe   *sqe_ptr;
+
+  // prepare the operation
+  sqe_ptr = get_sqe(TAG_ACCEPT, NULL);
+  sqe_ptr->opcode       = IORING_OP_ACCEPT;
+  sqe_ptr->fd           = sk_listen;
+  sqe_ptr->ioprio       = IORING_ACCEPT_MULTISHOT;
+  sqe_ptr->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+// **************************************************************************
+// receive packets from the client by a multishot operation into provided buffers
+static void arm_receive(struct client *client_ptr)
+{
+  struct io_uring_sqe   *sqe_ptr;
+
+  // prepare the operation
+  sqe_ptr = get_sqe(TAG_RECEIVE, client_ptr);
+  sqe_ptr->opcode    = IORING_OP_RECVMSG;
+  sqe_ptr->fd        = client_ptr->sk;
+  sqe_ptr->addr      = (uintptr_t)&receive_msghdr;
+  sqe_ptr->len       = 1;
+  sqe_ptr->msg_flags = MSG_CMSG_CLOEXEC;
+  sqe_ptr->ioprio    = IORING_RECV_MULTISHOT;
+  sqe_ptr->flags     = IOSQE_BUFFER_SELECT;
+  sqe_ptr->buf_group = 0;
+
+  // the client record must not be freed until the operation finishes
+  client_ptr->ops++;
+}
+
+// **************************************************************************
+// monitor the notification descriptor of the shared ring buffer by a multishot operation
+static void arm_poll(struct client *client_ptr)
+{
+  struct io_uring_sqe   *sqe_ptr;
+
+  // prepare the operation
+  sqe_ptr = get_sqe(TAG_POLL, client_ptr);
+  sqe_ptr->opcode        = IORING_OP_POLL_ADD;
+  sqe_ptr->fd            = client_ptr->poll_fd;
+  sqe_ptr->poll32_events = POLLIN;
+  sqe_ptr->len           = IORING_POLL_ADD_MULTI;
+
+  // the client record must not be freed until the operation finishes
+  client_ptr->ops++;
+}
+
+// **************************************************************************
+// set up the io_uring instance
+static void setup_uring(int sk_listen)
+{
+  struct io_uring_params params;
+  struct io_uring_buf_reg reg;
+  unsigned int          *array;
+  size_t                size;
+  char                  *ptr;
+  unsigned int          i;
+
+  // create the instance (completions are processed only when the main loop waits for them)
+  memset(&params, 0, sizeof(params));
+  params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = XBUS_URING_COMPLETIONS;
+  if ((uring.fd = syscall(SYS_io_uring_setup, XBUS_URING_ENTRIES, &params)) < 0) {
+    syslog(LOG_CRIT, "io_uring_setup error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+    syslog(LOG_CRIT, "io_uring_setup error: %s", "unsupported kernel");
+    exit(EXIT_FAILURE);
+  }
+
+  // map both queues at once
+  size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  if (size < params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe)) {
+    size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  }
+  if ((ptr = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    syslog(LOG_CRIT, "mmap error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  uring.sq_entries  = params.sq_entries;
+  uring.sq_mask     = *(unsigned int *)(ptr + params.sq_off.ring_mask);
+  uring.sq_head_ptr = (unsigned int *)(ptr + params.sq_off.head);
+  uring.sq_tail_ptr = (unsigned int *)(ptr + params.sq_off.tail);
+  uring.sq_tail     = *uring.sq_tail_ptr;
+  uring.cq_mask     = *(unsigned int *)(ptr + params.cq_off.ring_mask);
+  uring.cq_head_ptr = (unsigned int *)(ptr + params.cq_off.head);
+  uring.cq_tail_ptr = (unsigned int *)(ptr + params.cq_off.tail);
+  uring.cqes        = (struct io_uring_cqe *)(ptr + params.cq_off.cqes);
+
+  // entries of the submission queue are always used in order
+  array = (unsigned int *)(ptr + params.sq_off.array);
+  for (i = 0; i < params.sq_entries; i++) {
+    array[i] = i;
+  }
+
+  // map the array of entries of the submission queue
+  size = params.sq_entries * sizeof(struct io_uring_sqe);
+  if ((uring.sqes = (struct io_uring_sqe *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES)) == MAP_FAILED) {
+    syslog(LOG_CRIT, "mmap error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // register the ring of provided buffers (it must be page aligned)
+  size = XBUS_URING_BUFFERS * sizeof(struct io_uring_buf);
+  if ((uring.buffer_ring = (struct io_uring_buf_ring *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+    syslog(LOG_CRIT, "mmap error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr    = (uintptr_t)uring.buffer_ring;
+  reg.ring_entries = XBUS_URING_BUFFERS;
+  reg.bgid         = 0;
+  if (syscall(SYS_io_uring_register, uring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    syslog(LOG_CRIT, "io_uring_register error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // provide the buffers
+  uring.buffers = (char *)safe_alloc(XBUS_URING_BUFFERS * sizeof(struct buffer));
+  for (i = 0; i < XBUS_URING_BUFFERS; i++) {
+    recycle_buffer(i);
+  }
+
+  // describe the layout of provided buffers (no address, descriptors and a packet)
+  memset(&receive_msghdr, 0, sizeof(receive_msghdr));
+  receive_msghdr.msg_controllen = sizeof(union control);
+
+  // accept connections
+  arm_accept(sk_listen);
+}
+
+// **************************************************************************
+// start receiving packets from a new client
+static int watch_client(struct client *client_ptr)
+{
+  // arm the receive operation
+  arm_receive(client_ptr);
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// start monitoring the notification descriptor of the shared ring buffer
+static int watch_ring(struct client *client_ptr, int event_fd)
+{
+  // the descriptor is closed when the operation finishes
+  client_ptr->poll_fd = event_fd;
+  fcntl(event_fd, F_SETFL, O_NONBLOCK);
+  arm_poll(client_ptr);
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// stop monitoring the notification descriptor of the shared ring buffer
+static void unwatch_ring(struct client *client_ptr)
+{
+  struct io_uring_sqe   *sqe_ptr;
+
+  // remove the poll operation
+  sqe_ptr = get_sqe(TAG_NONE, NULL);
+  sqe_ptr->opcode = IORING_OP_POLL_REMOVE;
+  sqe_ptr->fd     = -1;
+  sqe_ptr->addr   = (uintptr_t)client_ptr | TAG_POLL;
+}
+#else
+// **************************************************************************
+// create the epoll instance and register the listening socket
+static void setup_epoll(int sk_listen)
+{
+  struct epoll_event    event;
+
+  // create the epoll instance
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    syslog(LOG_CRIT, "epoll_create error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // register the listening socket (identified by a null pointer)
+  event.events   = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sk_listen, &event) != 0) {
+    syslog(LOG_CRIT, "epoll_ctl error: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// **************************************************************************
+// start receiving packets from a new client
+static int watch_client(struct client *client_ptr)
+{
+  struct epoll_event    event;
+
+  // register the socket in the epoll instance
+  event.events   = EPOLLIN;
+  event.data.ptr = client_ptr;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_ptr->sk, &event) != 0) {
+    syslog(LOG_ERR, "epoll_ctl error: %s", strerror(errno));
+    return -1;
+  }
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// start monitoring the notification descriptor of the shared ring buffer together with the socket
+static int watch_ring(struct client *client_ptr, int event_fd)
+{
+  struct epoll_event    event;
+
+  // register the descriptor in the epoll instance
+  fcntl(event_fd, F_SETFL, O_NONBLOCK);
+  event.events   = EPOLLIN;
+  event.data.ptr = client_ptr;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+}
+
+// **************************************************************************
+// stop monitoring the notification descriptor of the shared ring buffer
+static void unwatch_ring(struct client *client_ptr)
+{
+  // the client keeps its own descriptor, so the notification must be removed from the epoll instance explicitly
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_ptr->ring_fd, NULL);
+  close(client_ptr->ring_fd);
+}
+#endif
+
+// **************************************************************************
+// create a client record
+static void create_client(int sk)
+{
+  struct client         *this_ptr;
+  socklen_t             optlen;
+
+  // create a new record
+  this_ptr = (struct client *)pool_alloc(&client_pool);
+
+  // set the content of the new record
+  this_ptr->sk             = sk;
+  this_ptr->closed         = 0;
+  this_ptr->broken         = 0;
+  this_ptr->binary         = 0;
+  this_ptr->memfd          = 0;
+  this_ptr->discarding     = 0;
+  this_ptr->blocked        = 0;
+  this_ptr->flushing       = 0;
+  this_ptr->overflow       = 0;
+  this_ptr->policy         = queue_policy;
+  this_ptr->priority       = PRIORITY_NORMAL;
+  this_ptr->events         = EPOLLIN;
+  this_ptr->worker_ptr     = NULL;
+  this_ptr->ring_ptr       = NULL;
+  this_ptr->ring_size      = 0;
+  this_ptr->ring_head      = 0;
+  this_ptr->ring_fd        = -1;
+#ifdef XBUS_URING
+  this_ptr->ops            = 0;
+  this_ptr->hangup         = 0;
+  this_ptr->deferred       = 0;
+  this_ptr->poll_fd        = -1;
+  this_ptr->quota          = 0;
+  this_ptr->round          = 0;
+  this_ptr->transmit_ptr   = NULL;
+#endif
+  this_ptr->name           = NULL;
+  this_ptr->mark           = 0;
+  this_ptr->dropped        = 0;
+  this_ptr->throttled      = 0;
+  this_ptr->rejected       = 0;
+  this_ptr->conflated      = 0;
+  this_ptr->interval       = 0;
+  this_ptr->queue_limit    = queue_limit;
+  this_ptr->write_ttl      = 0;
+  this_ptr->skip_unchanged = 0;
+  this_ptr->queue_size     = 0;
+  this_ptr->queue_head     = 0;
+  this_ptr->queue_count    = 0;
+  this_ptr->queue_offset   = 0;
+  this_ptr->queue          = NULL;
+  this_ptr->assembly_ptr   = NULL;
+  this_ptr->subscribe_ptr  = NULL;
+  this_ptr->aliases        = NULL;
+  this_ptr->alias_count    = 0;
+  this_ptr->slot_table      = NULL;
+  this_ptr->slot_table_size = 0;
+  this_ptr->slot_count      = 0;
+  this_ptr->limited_count  = 0;
+  this_ptr->batch_ptr      = NULL;
+  this_ptr->batch_timer.type    = TIMER_BATCH;
+  this_ptr->batch_timer.expires = 0;
+  this_ptr->flush_next_ptr = NULL;
+
+  // find the credentials of the client
+  optlen = sizeof(this_ptr->cred);
+  if (getsockopt(sk, SOL_SOCKET, SO_PEERCRED, &this_ptr->cred, &optlen) != 0) {
+    this_ptr->cred.pid = 0;
+    this_ptr->cred.uid = -1;
+    this_ptr->cred.gid = -1;
+  }
+
+  // assign the priority class to the client
+  this_ptr->priority = get_priority(this_ptr);
+
+  // assign a sending thread to the client (the process name is found in advance because it is shared by both threads,
+  // the set of events then refers to the epoll instance of the thread)
+  if (worker_count) {
+    this_ptr->worker_ptr = &workers[worker_next++ % worker_count];
+    this_ptr->events     = 0;
+    get_name(this_ptr);
+  }
+
+  // start receiving packets from the client
+  if (watch_client(this_ptr) != 0) {
+    close(sk);
+    if (this_ptr->name) {
+      arena_free(this_ptr->name);
+    }
+    pool_free(&client_pool, this_ptr);
+    return;
+  }
+
+  // add the new record to the list of clients
+  this_ptr->prev_ptr = NULL;
+  this_ptr->next_ptr = first_client_ptr;
+  if (first_client_ptr) {
+    first_client_ptr->prev_ptr = this_ptr;
+  }
+  first_client_ptr = this_ptr;
+
+  // write information to the log
+  debuglog("process %s connected", get_name(this_ptr));
+}
+
+// **************************************************************************
+// detach the shared ring buffer from the client
+static void detach_ring(struct client *client_ptr)
+{
+  // stop monitoring the notification descriptor
+  unwatch_ring(client_ptr);
+
+  // unmap the ring buffer
+  munmap(client_ptr->ring_ptr, sizeof(*client_ptr->ring_ptr) + client_ptr->ring_size);
+
+  // invalidate the ring buffer
+  client_ptr->ring_ptr  = NULL;
+  client_ptr->ring_size = 0;
+  client_ptr->ring_fd   = -1;
+}
+
+// **************************************************************************
+// close the connection and destroy all client's records
+static void close_client(struct client *this_ptr)
+{
+  struct subscribe      *next_ptr;
+  struct subscribe      *temp_ptr;
+  size_t                i;
+
+  // stop if the client is already closed
+  if (this_ptr->closed) {
+    return;
+  }
+
+  // write information to the log
+  debuglog("process %s disconnected", get_name(this_ptr));
+
+#ifdef XBUS_URING
+  // shut the connection down, so that pending io_uring operations finish (the socket is closed when the record is freed,
+  // the sending thread still sends all packets handed off before)
+  if (this_ptr->worker_ptr) {
+    shutdown(this_ptr->sk, SHUT_RD);
+  } else {
+    shutdown(this_ptr->sk, SHUT_RDWR);
+    this_ptr->broken = 1;
+  }
+#else
+  // close the connection (this also removes the socket from the epoll instance),
+  // the sending thread closes the socket itself after it sends all packets handed off before
+  if (this_ptr->worker_ptr) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, this_ptr->sk, NULL);
+  } else {
+    close(this_ptr->sk);
+    this_ptr->broken = 1;
+  }
+#endif
+
+  // detach the shared ring buffer
+  if (this_ptr->ring_ptr) {
+    detach_ring(this_ptr);
+  }
+
+  // remove an entry from the list of clients
+  if (this_ptr->prev_ptr) {
+    this_ptr->prev_ptr->next_ptr = this_ptr->next_ptr;
+  } else {
+    first_client_ptr = this_ptr->next_ptr;
+  }
+  if (this_ptr->next_ptr) {
+    this_ptr->next_ptr->prev_ptr = this_ptr->prev_ptr;
+  }
+
+  // destroy the list of subscribed topics
+  temp_ptr = this_ptr->subscribe_ptr;
+  while (temp_ptr) {
+    next_ptr = temp_ptr->next_ptr;
+    unindex_subscription(temp_ptr);
+    if (temp_ptr->filter_ptr) {
+      arena_free(temp_ptr->filter_ptr);
+    }
+    release_topic(temp_ptr->topic_ptr);
+    pool_free(&subscribe_pool, temp_ptr);
+    temp_ptr = next_ptr;
+  }
+  this_ptr->subscribe_ptr = NULL;
+
+  // destroy conflation slots
+  release_slots(this_ptr);
+  this_ptr->limited_count = 0;
+
+  // destroy batches of replies which have not been sent
+  release_batches(this_ptr);
+
+  // destroy the array of registered aliases
+  for (i = 0; i < this_ptr->alias_count; i++) {
+    release_topic(this_ptr->aliases[i]);
+  }
+  alias_total -= this_ptr->alias_count;
+  free(this_ptr->aliases);
+  this_ptr->aliases     = NULL;
+  this_ptr->alias_count = 0;
+
+  // move the record to the list of closed clients (it may still be referenced by pending events)
+  this_ptr->closed   = 1;
+  this_ptr->next_ptr = closed_client_ptr;
+  closed_client_ptr  = this_ptr;
+}
+
+// **************************************************************************
+// update the number of queued packets (it is read by the main thread when the client is served by a sending thread)
+static void set_queue_count(struct client *client_ptr, size_t count)
+{
+  __atomic_store_n(&client_ptr->queue_count, count, __ATOMIC_RELAXED);
+}
+
+// **************************************************************************
+// count a packet dropped for the client (it is read by the main thread when the client is served by a sending thread)
+static void count_dropped(struct client *client_ptr)
+{
+  __atomic_store_n(&client_ptr->dropped, client_ptr->dropped + 1, __ATOMIC_RELAXED);
+}
+
+// **************************************************************************
+// get the amount of memory charged for assembling the fragmented message
+static size_t get_assembly_size(const struct header *header)
+{
+  // the buffer holds the topic and the payload terminated by null characters
+  return sizeof(struct assembly) + header->topic_size + header->payload_size + 2;
+}
+
+// **************************************************************************
+// free the buffer of the fragmented message
+static void free_assembly(struct assembly *this_ptr)
+{
+  discharge_memory(get_assembly_size(&this_ptr->header));
+  free(this_ptr);
+}
+
+// **************************************************************************
+// destroy the output queue and free the client record
+static void destroy_client(struct client *this_ptr)
+{
+  // write information to the log
+  if (this_ptr->dropped) {
+    syslog(LOG_NOTICE, "process %s lost %lu packets", get_name(this_ptr), this_ptr->dropped);
+  }
+
+#ifdef XBUS_URING
+  // close the socket left open for io_uring operations and the sending thread
+  close(this_ptr->sk);
+  if (this_ptr->transmit_ptr) {
+    free(this_ptr->transmit_ptr);
+    discharge_memory(sizeof(*this_ptr->transmit_ptr));
+  }
+#else
+  // close the socket left open for the sending thread
+  if (this_ptr->worker_ptr) {
+    close(this_ptr->sk);
+  }
+#endif
+
+  // destroy the output queue
+  while (this_ptr->queue_count) {
+    release_packet(this_ptr->queue[this_ptr->queue_head]);
+    this_ptr->queue_head = (this_ptr->queue_head + 1) % this_ptr->queue_size;
+    set_queue_count(this_ptr, this_ptr->queue_count - 1);
+  }
+  free(this_ptr->queue);
+  discharge_memory(this_ptr->queue_size * sizeof(*this_ptr->queue));
+
+  // free allocated memory
+  if (this_ptr->assembly_ptr) {
+    free_assembly(this_ptr->assembly_ptr);
+  }
+  if (this_ptr->name) {
+    arena_free(this_ptr->name);
+  }
+  pool_free(&client_pool, this_ptr);
+}
+
+// **************************************************************************
+// wake the sending thread up if it sleeps
+static void wake_worker(struct worker *worker_ptr)
+{
+  uint64_t              value;
+
+  // the flag is set by the thread before it checks the handoff queue for the last time
+  if (__atomic_load_n(&worker_ptr->sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&worker_ptr->sleeping, 0, __ATOMIC_SEQ_CST)) {
+    value = 1;
+    if (write(worker_ptr->event_fd, &value, sizeof(value)) != sizeof(value)) {
+      syslog(LOG_ERR, "eventfd write error: %s", strerror(errno));
+    }
+  }
+}
+
+// **************************************************************************
+// hand the packet off to the sending thread of the client
+static void handoff_packet(struct client *client_ptr, struct packet *packet_ptr)
+{
+  struct worker         *worker_ptr;
+  struct handoff        *handoff_ptr;
+  uint32_t              head;
+
+  // sleep until the handoff queue has free space (the flag is set before the queue is checked for the last time and
+  // the thread wakes the main thread up once it releases entries)
+  worker_ptr = client_ptr->worker_ptr;
+  while (worker_ptr->tail - (head = __atomic_load_n(&worker_ptr->head, __ATOMIC_ACQUIRE)) >= XBUS_HANDOFF_SIZE) {
+    __atomic_store_n(&worker_ptr->waiting, 1, __ATOMIC_SEQ_CST);
+    if (worker_ptr->tail - (head = __atomic_load_n(&worker_ptr->head, __ATOMIC_SEQ_CST)) < XBUS_HANDOFF_SIZE) {
+      break;
+    }
+    wake_worker(worker_ptr);
+    syscall(SYS_futex, &worker_ptr->head, FUTEX_WAIT_PRIVATE, head, NULL, NULL, 0);
+  }
+
+  // append the packet to the handoff queue
+  handoff_ptr = &worker_ptr->queue[worker_ptr->tail & (XBUS_HANDOFF_SIZE - 1)];
+  handoff_ptr->client_ptr = client_ptr;
+  handoff_ptr->packet_ptr = packet_ptr ? hold_packet(packet_ptr) : NULL;
+  __atomic_store_n(&worker_ptr->tail, worker_ptr->tail + 1, __ATOMIC_RELEASE);
+
+  // the thread is woken up after all events are processed
+  worker_ptr->pending = 1;
+}
+
+// **************************************************************************
+// wake up all sending threads with handed off packets
+static void notify_workers(void)
+{
+  size_t                i;
+
+  // make published packets visible before the flags are checked
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  // wake the threads up
+  for (i = 0; i < worker_count; i++) {
+    if (workers[i].pending) {
+      workers[i].pending = 0;
+      wake_worker(&workers[i]);
+    }
+  }
+}
+
+// **************************************************************************
+// free records of all closed clients
+static void free_closed_clients(void)
+{
+  struct client         **list_ptr;
+  struct client         *this_ptr;
+
+  // traverse the list of closed clients (records of clients served by sending threads are freed by these threads)
+  list_ptr = &closed_client_ptr;
+  while ((this_ptr = *list_ptr)) {
+#ifdef XBUS_URING
+    // keep records referenced by unfinished io_uring operations or deferred completions
+    if (this_ptr->ops || this_ptr->deferred) {
+      list_ptr = &this_ptr->next_ptr;
+      continue;
+    }
+#endif
+    *list_ptr = this_ptr->next_ptr;
+    if (this_ptr->worker_ptr) {
+      handoff_packet(this_ptr, NULL);
+    } else {
+      destroy_client(this_ptr);
+    }
+  }
+}
+
+// **************************************************************************
+// stop sending packets to the client and close the connection
+static void drop_client(struct client *client_ptr)
+{
+  // the main thread closes the connection immediately
+  if (!client_ptr->worker_ptr) {
+    close_client(client_ptr);
+    return;
+  }
+
+  // a sending thread shuts the connection down, the main thread then finds it closed
+  shutdown(client_ptr->sk, SHUT_RDWR);
+  client_ptr->broken = 1;
+
+  // stop monitoring the socket
+  if (client_ptr->events) {
+    epoll_ctl(client_ptr->worker_ptr->epoll_fd, EPOLL_CTL_DEL, client_ptr->sk, NULL);
+    client_ptr->events = 0;
+  }
+}
+
+// **************************************************************************
+// update the set of events monitored for the client
+static void update_events(struct client *client_ptr)
+{
+  struct epoll_event    event;
+  int                   op;
+  int                   fd;
+
+  // prepare the set of events (a sending thread monitors only whether the socket is writable)
+  if (client_ptr->worker_ptr) {
+    event.events = client_ptr->blocked ? EPOLLOUT : 0;
+    op = !client_ptr->events ? EPOLL_CTL_ADD : event.events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    fd = client_ptr->worker_ptr->epoll_fd;
+  } else {
+    event.events = client_ptr->blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    op = EPOLL_CTL_MOD;
+    fd = epoll_fd;
+  }
+  event.data.ptr = client_ptr;
+
+  // modify the registration in the epoll instance if the set has changed
+  if (event.events != client_ptr->events) {
+    if (epoll_ctl(fd, op, client_ptr->sk, &event) != 0) {
+      syslog(LOG_ERR, "epoll_ctl error: %s", strerror(errno));
+    }
+    client_ptr->events = event.events;
+  }
+}
+
+// **************************************************************************
+// enlarge the circular buffer of the output queue
+static void enlarge_queue(struct client *client_ptr)
+{
+  struct packet         **queue;
+  size_t                size;
+  size_t                i;
+
+  // allocate a new buffer
+  size  = client_ptr->queue_size ? 2 * client_ptr->queue_size : 8;
+  queue = (struct packet **)safe_alloc(size * sizeof(*queue));
+
+  // move queued packets to the beginning of the new buffer
+  for (i = 0; i < client_ptr->queue_count; i++) {
+    queue[i] = client_ptr->queue[(client_ptr->queue_head + i) % client_ptr->queue_size];
+  }
+
+  // replace the old buffer
+  free(client_ptr->queue);
+  discharge_memory(client_ptr->queue_size * sizeof(*queue));
+  charge_memory(size * sizeof(*queue));
+  client_ptr->queue      = queue;
+  client_ptr->queue_size = size;
+  client_ptr->queue_head = 0;
+}
+
+// **************************************************************************
+// drop the oldest packet of the output queue which may be dropped (the partially sent packet at the head must be
+// finished and replies are awaited by the client)
+static int drop_oldest(struct client *client_ptr)
+{
+  struct packet         **queue;
+  size_t                size;
+  size_t                head;
+  size_t                i;
+
+  // find the packet
+  queue = client_ptr->queue;
+  size  = client_ptr->queue_size;
+  head  = client_ptr->queue_head;
+  for (i = client_ptr->queue_offset ? 1 : 0; i < client_ptr->queue_count; i++) {
+    if (queue[(head + i) % size]->header.opcode != OP_REPLY) {
+      break;
+    }
+  }
+  if (i == client_ptr->queue_count) {
+    return -1;
+  }
+
+  // release it and move the packets before it one place forward
+  release_packet(queue[(head + i) % size]);
+  for (; i > 0; i--) {
+    queue[(head + i) % size] = queue[(head + i - 1) % size];
+  }
+  client_ptr->queue_head = (head + 1) % size;
+  set_queue_count(client_ptr, client_ptr->queue_count - 1);
+  count_dropped(client_ptr);
+  return 0;
+}
+
+// **************************************************************************
+// append the packet to the output queue of the client
+static void queue_packet(struct client *client_ptr, struct packet *packet_ptr)
+{
+  size_t                limit;
+
+  // the limit and the policy are changed by the main thread when the client is served by a sending thread
+  limit = __atomic_load_n(&client_ptr->queue_limit, __ATOMIC_RELAXED);
+
+  // disconnect the client if it does not read replies (replies are never dropped because the client waits for them,
+  // their number is limited by the client, which waits for each reply, or by pacing of batches, see send_batches(),
+  // so the queue may exceed the limit of the client by at most the limit of the broker)
+  if (client_ptr->queue_count >= limit + queue_limit && packet_ptr->header.opcode == OP_REPLY) {
+    syslog(LOG_WARNING, "process %s disconnected due to unread replies", get_name(client_ptr));
+    drop_client(client_ptr);
+    return;
+  }
+
+  // apply the overflow policy if the queue is full
+  if (client_ptr->queue_count >= limit && packet_ptr->header.opcode != OP_REPLY) {
+    if (!client_ptr->overflow) {
+      syslog(LOG_WARNING, "process %s is too slow, output queue is full", get_name(client_ptr));
+      client_ptr->overflow = 1;
+    }
+    switch (__atomic_load_n(&client_ptr->policy, __ATOMIC_RELAXED)) {
+      case POLICY_DROP_OLDEST:
+        while (client_ptr->queue_count >= limit) {
+          if (drop_oldest(client_ptr) != 0) {
+            count_dropped(client_ptr);
+            return;
+          }
+        }
+        break;
+      case POLICY_DISCONNECT:
+        syslog(LOG_WARNING, "process %s disconnected due to full output queue", get_name(client_ptr));
+        drop_client(client_ptr);
+        return;
+      default:
+        count_dropped(client_ptr);
+        return;
+    }
+  }
+
+  // enlarge the buffer if necessary
+  if (client_ptr->queue_count == client_ptr->queue_size) {
+    enlarge_queue(client_ptr);
+  }
+
+  // append the packet to the queue
+  client_ptr->queue[(client_ptr->queue_head + client_ptr->queue_count) % client_ptr->queue_size] = hold_packet(packet_ptr);
+  set_queue_count(client_ptr, client_ptr->queue_count + 1);
+}
+
+// **************************************************************************
+// describe the next part of the packet in the format used by the client
+static int fill_iovec(struct client *client_ptr, struct packet *packet_ptr, size_t *offset, struct header *header, struct iovec *iov)
+{
+  size_t                size;
+
+  // the text form consists of the topic, a newline character and the payload terminated by a null character
+  if (!__atomic_load_n(&client_ptr->binary, __ATOMIC_RELAXED)) {
+    iov[0].iov_base = packet_ptr->data;
+    iov[0].iov_len  = packet_ptr->topic_size + 1;
+    iov[1].iov_base = packet_ptr->payload;
+    iov[1].iov_len  = packet_ptr->payload_size + 1;
+    return 2;
+  }
+
+  // a payload in a memory file is passed to a capable client as a descriptor
+  if (packet_ptr->fd >= 0 && __atomic_load_n(&client_ptr->memfd, __ATOMIC_RELAXED)) {
+    *header = packet_ptr->header;
+    header->flags |= FLAG_MEMFD;
+    iov[0].iov_base = header;
+    iov[0].iov_len  = sizeof(*header);
+    iov[1].iov_base = packet_ptr->data;
+    iov[1].iov_len  = packet_ptr->topic_size;
+    iov[2].iov_base = "";
+    iov[2].iov_len  = 1;
+    return 3;
+  }
+
+  // the binary form consists of the header, the topic, a null character and the payload
+  if (!*offset) {
+    *header = packet_ptr->header;
+    size    = packet_ptr->payload_size;
+    if (sizeof(*header) + packet_ptr->topic_size + size + 1 >= XBUS_MAX_SIZE) {
+      size = XBUS_MAX_SIZE - sizeof(*header) - packet_ptr->topic_size - 2;
+      header->flags |= FLAG_MORE;
+      *offset = size;
+    }
+    iov[0].iov_base = header;
+    iov[0].iov_len  = sizeof(*header);
+    iov[1].iov_base = packet_ptr->data;
+    iov[1].iov_len  = packet_ptr->topic_size;
+    iov[2].iov_base = "";
+    iov[2].iov_len  = 1;
+    iov[3].iov_base = packet_ptr->payload;
+    iov[3].iov_len  = size;
+    return 4;
+  }
+
+  // a continuation of a large payload consists of the header, a null character and the next part of the payload
+  size = packet_ptr->payload_size - *offset;
+  memset(header, 0, sizeof(*header));
+  header->opcode = OP_CONTINUE;
+  if (sizeof(*header) + size + 1 >= XBUS_MAX_SIZE) {
+    size = XBUS_MAX_SIZE - sizeof(*header) - 2;
+    header->flags = FLAG_MORE;
+  }
+  header->payload_size = size;
+  iov[0].iov_base = header;
+  iov[0].iov_len  = sizeof(*header);
+  iov[1].iov_base = "";
+  iov[1].iov_len  = 1;
+  iov[2].iov_base = packet_ptr->payload + *offset;
+  iov[2].iov_len  = size;
+  *offset = header->flags & FLAG_MORE ? *offset + size : 0;
+  return 3;
+}
+
+#ifdef XBUS_URING
+// **************************************************************************
+// submit a batch of queued packets to the io_uring instance
+static void submit_queue(struct client *client_ptr)
+{
+  struct io_uring_sqe   *sqe_ptr;
+  struct transmit       *transmit_ptr;
+  struct packet         *packet_ptr;
+  struct cmsghdr        *cmsg;
+  int                   count;
+  int                   i;
+
+  // only one batch per client may be in flight (the next one is submitted when it finishes)
+  if (!client_ptr->transmit_ptr) {
+    client_ptr->transmit_ptr = (struct transmit *)safe_alloc(sizeof(*client_ptr->transmit_ptr));
+    charge_memory(sizeof(*client_ptr->transmit_ptr));
+    client_ptr->transmit_ptr->count = 0;
+    client_ptr->transmit_ptr->done  = 0;
+  }
+  transmit_ptr = client_ptr->transmit_ptr;
+  if (transmit_ptr->count) {
+    return;
+  }
+
+  // move a batch of packets from the queue to the batch (a large packet may be split into several parts)
+  memset(transmit_ptr->msgs, 0, sizeof(transmit_ptr->msgs));
+  for (count = 0; count < XBUS_BATCH_SIZE && client_ptr->queue_count; count++) {
+    packet_ptr = client_ptr->queue[client_ptr->queue_head];
+    transmit_ptr->packets[count]         = hold_packet(packet_ptr);
+    transmit_ptr->msgs[count].msg_iov    = transmit_ptr->iovs[count];
+    transmit_ptr->msgs[count].msg_iovlen = fill_iovec(client_ptr, packet_ptr, &client_ptr->queue_offset,
+                                                      &transmit_ptr->headers[count], transmit_ptr->iovs[count]);
+    if (client_ptr->binary && client_ptr->memfd && packet_ptr->fd >= 0) {
+      transmit_ptr->msgs[count].msg_control    = transmit_ptr->controls[count].data;
+      transmit_ptr->msgs[count].msg_controllen = CMSG_SPACE(sizeof(int));
+      cmsg             = CMSG_FIRSTHDR(&transmit_ptr->msgs[count]);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type  = SCM_RIGHTS;
+      cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &packet_ptr->fd, sizeof(int));
+    }
+    if (!client_ptr->queue_offset) {
+      release_packet(packet_ptr);
+      client_ptr->queue_head = (client_ptr->queue_head + 1) % client_ptr->queue_size;
+      set_queue_count(client_ptr, client_ptr->queue_count - 1);
+    }
+  }
+  transmit_ptr->count = count;
+
+  // reset the overflow indication if the queue is empty
+  if (!client_ptr->queue_count) {
+    client_ptr->overflow = 0;
+  }
+
+  // submit the batch as a chain of operations, so that the packets are sent in order
+  // (the chain must not be split between submissions and a hard link is not broken by a failure)
+  reserve_sqes(count);
+  for (i = 0; i < count; i++) {
+    sqe_ptr = get_sqe(TAG_SEND, client_ptr);
+    sqe_ptr->opcode    = IORING_OP_SENDMSG;
+    sqe_ptr->fd        = client_ptr->sk;
+    sqe_ptr->addr      = (uintptr_t)&transmit_ptr->msgs[i];
+    sqe_ptr->len       = 1;
+    sqe_ptr->msg_flags = MSG_EOR | MSG_NOSIGNAL;
+    sqe_ptr->flags     = i < count - 1 ? IOSQE_IO_HARDLINK : 0;
+  }
+
+  // the client record must not be freed until the operations finish
+  client_ptr->ops += count;
+}
+#endif
+
+// **************************************************************************
+// send queued packets to the client
+static void flush_queue(struct client *client_ptr)
+{
+  struct mmsghdr        msgs[XBUS_BATCH_SIZE];
+  struct iovec          iovs[XBUS_BATCH_SIZE][4];
+  struct header         headers[XBUS_BATCH_SIZE];
+  union control         controls[XBUS_BATCH_SIZE];
+  size_t                offsets[XBUS_BATCH_SIZE];
+  struct cmsghdr        *cmsg;
+  struct packet         *packet_ptr;
+  size_t                offset;
+  size_t                index;
+  int                   count;
+  int                   sent;
+  int                   i;
+
+#ifdef XBUS_URING
+  // packets for clients served by the main thread are sent by the io_uring instance
+  if (!client_ptr->worker_ptr) {
+    submit_queue(client_ptr);
+    return;
+  }
+#endif
+
+  // send packets until the queue is empty or the socket is full (a client which has closed the connection
+  // receives nothing more, but the connection is kept until all packets the client has sent are received)
+  while (client_ptr->queue_count && !client_ptr->blocked && !client_ptr->broken) {
+
+    // prepare a batch of packets (a large packet may be split into several parts)
+    memset(msgs, 0, sizeof(msgs));
+    offset = client_ptr->queue_offset;
+    index  = 0;
+    for (count = 0; count < XBUS_BATCH_SIZE && index < client_ptr->queue_count; count++) {
+      packet_ptr = client_ptr->queue[(client_ptr->queue_head + index) % client_ptr->queue_size];
+      msgs[count].msg_hdr.msg_iov    = iovs[count];
+      msgs[count].msg_hdr.msg_iovlen = fill_iovec(client_ptr, packet_ptr, &offset, &headers[count], iovs[count]);
+      if (__atomic_load_n(&client_ptr->binary, __ATOMIC_RELAXED) && __atomic_load_n(&client_ptr->memfd, __ATOMIC_RELAXED) &&
+          packet_ptr->fd >= 0) {
+        msgs[count].msg_hdr.msg_control    = controls[count].data;
+        msgs[count].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+        cmsg             = CMSG_FIRSTHDR(&msgs[count].msg_hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &packet_ptr->fd, sizeof(int));
+      }
+      offsets[count] = offset;
+      if (!offset) {
+        index++;
+      }
+    }
+
+    // send the batch of packets
+    if ((sent = sendmmsg(client_ptr->sk, msgs, count, MSG_EOR | MSG_DONTWAIT | MSG_NOSIGNAL)) < 0) {
+      if (errno == EAGAIN || errno == ENOBUFS) {
+        client_ptr->blocked = 1;
+        break;
+      }
+      if (errno == EPIPE || errno == ECONNRESET) {
+        client_ptr->broken = 1;
+        break;
+      }
+      if (errno != EMSGSIZE) {
+        drop_client(client_ptr);
+        return;
+      }
+      count_dropped(client_ptr);
+      offsets[0] = 0;
+      sent = 1;
+    }
+
+    // remove sent packets from the queue
+    for (i = 0; i < sent; i++) {
+      client_ptr->queue_offset = offsets[i];
+      if (!offsets[i]) {
+        release_packet(client_ptr->queue[client_ptr->queue_head]);
+        client_ptr->queue_head = (client_ptr->queue_head + 1) % client_ptr->queue_size;
+        set_queue_count(client_ptr, client_ptr->queue_count - 1);
+      }
+    }
+  }
+
+  // reset the overflow indication if the queue is empty
+  if (!client_ptr->queue_count) {
+    client_ptr->overflow = 0;
+  }
+
+  // update the set of events monitored for the client
+  update_events(client_ptr);
+}
+
+// **************************************************************************
+// send queued packets to all clients in the list of clients with unsent packets
+static void flush_clients(struct client **list_ptr)
+{
+  struct client         *this_ptr;
+
+  // traverse the list of clients with unsent packets
+  while ((this_ptr = *list_ptr)) {
+    *list_ptr          = this_ptr->flush_next_ptr;
+    this_ptr->flushing = 0;
+    if (!this_ptr->broken) {
+      flush_queue(this_ptr);
+    }
+  }
+}
+
+// **************************************************************************
+// append the packet to the output queue of the client and send it or add the client to the list of clients with unsent packets
+static void deliver_packet(struct client *client_ptr, struct packet *packet_ptr, struct client **list_ptr)
+{
+  // stop if the connection is broken
+  if (client_ptr->broken) {
+    return;
+  }
+
+  // append the packet to the output queue
+  queue_packet(client_ptr, packet_ptr);
+
+  // stop if the socket is full
+  if (client_ptr->blocked || client_ptr->broken) {
+    return;
+  }
+
+  // send a full batch of packets immediately, otherwise defer sending until all events are processed
+  if (client_ptr->queue_count >= XBUS_BATCH_SIZE) {
+    flush_queue(client_ptr);
+  } else if (!client_ptr->flushing) {
+    client_ptr->flushing       = 1;
+    client_ptr->flush_next_ptr = *list_ptr;
+    *list_ptr                  = client_ptr;
+  }
+}
+
+// **************************************************************************
+// send the packet to the client
+static void send_packet(struct client *client_ptr, struct packet *packet_ptr)
+{
+  // stop if the client is closed
+  if (client_ptr->closed) {
+    return;
+  }
+
+  // account the work
+  work_count++;
+
+  // hand the packet off to the sending thread of the client or deliver it directly
+  if (client_ptr->worker_ptr) {
+    handoff_packet(client_ptr, packet_ptr);
+  } else {
+    deliver_packet(client_ptr, packet_ptr, &flush_client_ptr);
+  }
+}
+
+// **************************************************************************
+// send the packet to the client as the reply to its request with the correlation identifier (zero means that
+// the request has no identifier and the packet itself is sent)
+static void send_response(struct client *client_ptr, struct packet *packet_ptr, unsigned long id)
+{
+  struct packet         *reply_ptr;
+
+  // send the packet without the identifier
+  if (!id) {
+    send_packet(client_ptr, packet_ptr);
+    return;
+  }
+
+  // send the reply with the identifier
+  reply_ptr = create_reply_packet(packet_ptr, id, 0);
+  send_packet(client_ptr, reply_ptr);
+  release_packet(reply_ptr);
+}
+
+// **************************************************************************
+// create a packet and send it to the client
+static void send_reply(struct client *client_ptr, const char *topic, const char *payload, unsigned long id)
+{
+  struct packet         *packet_ptr;
+
+  // create the packet
+  packet_ptr = create_packet(topic, payload, strlen(payload));
+
+  // send the packet to the client
+  send_response(client_ptr, packet_ptr, id);
+
+  // release the packet
+  release_packet(packet_ptr);
+}
+
+// **************************************************************************
+// report the rejected command to the client by a message on the topic "%error" (the payload contains options
+// "command=<command>", "topic=<topic>" and "error=<error>", the last one up to the end of the payload)
+static void send_error(struct client *client_ptr, int opcode, const char *topic, const char *error)
+{
+  char                  payload[XBUS_MAX_SIZE];
+
+  // send the message
+  snprintf(payload, sizeof(payload), "command=%s topic=%s error=%s", command_names[opcode], topic, error);
+  send_reply(client_ptr, "%error", payload, 0);
+}
+
+// **************************************************************************
+// find a child node of the radix tree according to the first character of its key
+static size_t find_store_child(const struct store_node *node_ptr, unsigned char c)
+{
+  size_t                low;
+  size_t                high;
+  size_t                mid;
+
+  // perform binary search in the sorted array of children
+  low  = 0;
+  high = node_ptr->count;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if ((unsigned char)node_ptr->children[mid]->key[0] < c) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // return the index of the child or the position where it should be inserted
+  return low;
+}
+
+// **************************************************************************
+// create a node of the radix tree
+static struct store_node *create_store_node(const char *key, size_t length, struct store_node *parent_ptr)
+{
+  struct store_node     *this_ptr;
+
+  // create a new record
+  this_ptr = (struct store_node *)pool_alloc(&store_pool);
+
+  // set the content of the new record
+  this_ptr->key         = arena_strndup(key, length);
+  this_ptr->length      = length;
+  this_ptr->count       = 0;
+  this_ptr->children    = NULL;
+  this_ptr->message_ptr = NULL;
+  this_ptr->parent_ptr  = parent_ptr;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// insert a child node into the sorted array of children
+static void insert_store_child(struct store_node *node_ptr, size_t index, struct store_node *child_ptr)
+{
+  // enlarge the array of children
+  node_ptr->children = (struct store_node **)safe_realloc(node_ptr->children, (node_ptr->count + 1) * sizeof(*node_ptr->children));
+
+  // insert the child at the given position
+  memmove(&node_ptr->children[index + 1], &node_ptr->children[index], (node_ptr->count - index) * sizeof(*node_ptr->children));
+  node_ptr->children[index] = child_ptr;
+  node_ptr->count++;
+}
+
+// **************************************************************************
+// find or create a node of the radix tree for the topic
+static struct store_node *get_store_node(const char *topic)
+{
+  struct store_node     *node_ptr;
+  struct store_node     *child_ptr;
+  struct store_node     *split_ptr;
+  size_t                index;
+  size_t                i;
+
+  // descend the tree along the topic
+  node_ptr = &store_root;
+  while (*topic) {
+
+    // find a child node beginning with the next character
+    index = find_store_child(node_ptr, *topic);
+    if (index == node_ptr->count || node_ptr->children[index]->key[0] != *topic) {
+      child_ptr = create_store_node(topic, strlen(topic), node_ptr);
+      insert_store_child(node_ptr, index, child_ptr);
+      return child_ptr;
+    }
+    child_ptr = node_ptr->children[index];
+
+    // find the length of the common prefix
+    for (i = 1; i < child_ptr->length && child_ptr->key[i] == topic[i]; i++)
+      ;
+
+    // split the child node if the topic diverges inside its key
+    if (i < child_ptr->length) {
+      split_ptr = create_store_node(child_ptr->key, i, node_ptr);
+      memmove(child_ptr->key, child_ptr->key + i, child_ptr->length - i + 1);
+      child_ptr->length    -= i;
+      child_ptr->parent_ptr = split_ptr;
+      insert_store_child(split_ptr, 0, child_ptr);
+      node_ptr->children[index] = split_ptr;
+      child_ptr = split_ptr;
+    }
+
+    // continue with the child node
+    node_ptr = child_ptr;
+    topic   += i;
+  }
+
+  // return a pointer to the found node
+  return node_ptr;
+}
+
+// **************************************************************************
+// destroy unused leaf nodes of the radix tree
+static void release_store_node(struct store_node *this_ptr)
+{
+  struct store_node     *parent_ptr;
+  size_t                index;
+
+  // traverse the nodes up to the root
+  while (this_ptr != &store_root && !this_ptr->message_ptr && !this_ptr->count) {
+
+    // remove the node from the array of children of its parent
+    parent_ptr = this_ptr->parent_ptr;
+    index      = find_store_child(parent_ptr, this_ptr->key[0]);
+    memmove(&parent_ptr->children[index], &parent_ptr->children[index + 1], (parent_ptr->count - index - 1) * sizeof(*parent_ptr->children));
+    parent_ptr->count--;
+
+    // free allocated memory
+    arena_free(this_ptr->key);
+    free(this_ptr->children);
+    pool_free(&store_pool, this_ptr);
+
+    // continue with the parent node
+    this_ptr = parent_ptr;
+  }
+}
+
+// **************************************************************************
+// find a stored message according to the topic
+static struct message *find_stored_message(const char *topic)
+{
+  struct topic          *topic_ptr;
+
+  // find the interned topic
+  topic_ptr = find_topic(topic);
+
+  // return a pointer to the record
+  return topic_ptr ? topic_ptr->message_ptr : NULL;
+}
+
+// **************************************************************************
+// find the amount of memory charged for the stored packet (including rounding to size classes of the string arena)
+static size_t get_packet_size(const struct packet *packet_ptr)
+{
+  // return the size of the block with the packet
+  return get_arena_size(sizeof(*packet_ptr) + packet_ptr->size);
+}
+
+// **************************************************************************
+// add the stored message to the beginning of the list of recently used messages
+static void link_lru(struct message *this_ptr)
+{
+  this_ptr->lru_prev_ptr = NULL;
+  this_ptr->lru_next_ptr = lru_first_ptr;
+  if (lru_first_ptr) {
+    lru_first_ptr->lru_prev_ptr = this_ptr;
+  } else {
+    lru_last_ptr = this_ptr;
+  }
+  lru_first_ptr = this_ptr;
+}
+
+// **************************************************************************
+// remove the stored message from the list of recently used messages
+static void unlink_lru(struct message *this_ptr)
+{
+  if (this_ptr->lru_prev_ptr) {
+    this_ptr->lru_prev_ptr->lru_next_ptr = this_ptr->lru_next_ptr;
+  } else {
+    lru_first_ptr = this_ptr->lru_next_ptr;
+  }
+  if (this_ptr->lru_next_ptr) {
+    this_ptr->lru_next_ptr->lru_prev_ptr = this_ptr->lru_prev_ptr;
+  } else {
+    lru_last_ptr = this_ptr->lru_prev_ptr;
+  }
+}
+
+// **************************************************************************
+// mark the stored message as the most recently used one
+static void touch_message(struct message *this_ptr)
+{
+  if (lru_first_ptr != this_ptr) {
+    unlink_lru(this_ptr);
+    link_lru(this_ptr);
+  }
+}
+
+// **************************************************************************
+// store a received message of the given version which expires at the given time (zero means never)
+static struct message *store_message(const char *topic, struct packet *packet_ptr, uint64_t expires, uint64_t version)
+{
+  struct topic          *topic_ptr;
+  struct message        *this_ptr;
+
+  // copy a payload passed in a memory file, stored messages do not keep the descriptor and the mapping
+  packet_ptr = packet_ptr->fd >= 0 ? create_packet(topic, packet_ptr->payload, packet_ptr->payload_size) : hold_packet(packet_ptr);
+
+  // intern the topic and update the content of an existing record if was found
+  topic_ptr = intern_topic(topic);
+  if ((this_ptr = topic_ptr->message_ptr)) {
+    release_topic(topic_ptr);
+    release_packet(this_ptr->packet_ptr);
+    this_ptr->packet_ptr = packet_ptr;
+    if (this_ptr->timer.expires) {
+      remove_timer(&this_ptr->timer);
+    }
+    touch_message(this_ptr);
+    store_size -= this_ptr->size;
+  } else {
+
+    // create a new record
+    this_ptr = (struct message *)pool_alloc(&message_pool);
+
+    // set the content of the new record
+    this_ptr->topic_ptr     = topic_ptr;
+    this_ptr->packet_ptr    = packet_ptr;
+    this_ptr->node_ptr      = get_store_node(topic);
+    this_ptr->timer.type    = TIMER_MESSAGE;
+    this_ptr->timer.expires = 0;
+    this_ptr->mark          = 0;
+
+    // attach the new record to the interned topic and to the node of the radix tree (the tree is used to find
+    // stored messages matching a topic pattern)
+    topic_ptr->message_ptr          = this_ptr;
+    this_ptr->node_ptr->message_ptr = this_ptr;
+
+    // make the record the most recently used one
+    link_lru(this_ptr);
+    store_count++;
+  }
+
+  // update the size of stored messages
+  this_ptr->size = get_packet_size(packet_ptr);
+  store_size    += this_ptr->size;
+
+  // set the version of the message
+  this_ptr->version = version;
+
+  // schedule the expiration of the message
+  if (expires) {
+    add_timer(&this_ptr->timer, expires);
+  }
+
+  // return a pointer to the record
+  return this_ptr;
+}
+
+// **************************************************************************
+// remove the stored message
+static void remove_stored_message(struct message *this_ptr)
+{
+  // cancel the expiration of the message
+  if (this_ptr->timer.expires) {
+    remove_timer(&this_ptr->timer);
+  }
+
+  // remove the record from the list of recently used messages
+  unlink_lru(this_ptr);
+  store_count--;
+  store_size -= this_ptr->size;
+
+  // detach the record from the interned topic and from the node of the radix tree
+  this_ptr->topic_ptr->message_ptr = NULL;
+  this_ptr->node_ptr->message_ptr  = NULL;
+  release_topic(this_ptr->topic_ptr);
+  release_store_node(this_ptr->node_ptr);
+
+  // free allocated memory
+  release_packet(this_ptr->packet_ptr);
+  pool_free(&message_pool, this_ptr);
+}
+
+// **************************************************************************
+// visit all stored messages in the subtree in lexicographic order
+static void visit_store_subtree(struct store_node *node_ptr, void (*visit)(struct message *, void *), void *arg)
+{
+  size_t                i;
+
+  // visit the message of the node
+  if (node_ptr->message_ptr) {
+    visit(node_ptr->message_ptr, arg);
+  }
+
+  // visit all children
+  for (i = 0; i < node_ptr->count; i++) {
+    visit_store_subtree(node_ptr->children[i], visit, arg);
+  }
+}
+
+// **************************************************************************
+// visit all stored messages matching the regular expression
+static void visit_store_matches(struct store_node *node_ptr, size_t offset, const char *regex, int boundary,
+                                void (*visit)(struct message *, void *), void *arg)
+{
+  struct store_node     *child_ptr;
+  size_t                index;
+  size_t                i;
+
+  // process the regular expression at the position after the offset-th character of the node key
+  switch (*regex) {
+
+    // the end of the regular expression matches only the end of the topic
+    case '\0':
+      if (offset == node_ptr->length && node_ptr->message_ptr) {
+        visit(node_ptr->message_ptr, arg);
+      }
+      break;
+
+    // the wildcard '*' matches the rest of the topic
+    case '*':
+      if (!boundary) {
+        visit_store_subtree(node_ptr, visit, arg);
+      } else if (offset < node_ptr->length) {
+        if (node_ptr->key[offset] == '/') {
+          visit_store_subtree(node_ptr, visit, arg);
+        }
+      } else {
+        if (node_ptr->message_ptr) {
+          visit(node_ptr->message_ptr, arg);
+        }
+        index = find_store_child(node_ptr, '/');
+        if (index < node_ptr->count && node_ptr->children[index]->key[0] == '/') {
+          visit_store_subtree(node_ptr->children[index], visit, arg);
+        }
+      }
+      break;
+
+    // the wildcard '+' matches the rest of the topic level
+    case '+':
+      visit_store_matches(node_ptr, offset, regex + 1, 1, visit, arg);
+      if (boundary) {
+        break;
+      }
+      if (offset < node_ptr->length) {
+        if (node_ptr->key[offset] != '/') {
+          visit_store_matches(node_ptr, offset + 1, regex, 0, visit, arg);
+        }
+      } else {
+        for (i = 0; i < node_ptr->count; i++) {
+          child_ptr = node_ptr->children[i];
+          if (child_ptr->key[0] != '/') {
+            visit_store_matches(child_ptr, 1, regex, 0, visit, arg);
+          }
+        }
+      }
+      break;
+
+    // other characters must match exactly
+    default:
+      if (boundary && *regex != '/') {
+        break;
+      }
+      if (offset < node_ptr->length) {
+        if (node_ptr->key[offset] == *regex) {
+          visit_store_matches(node_ptr, offset + 1, regex + 1, 0, visit, arg);
+        }
+      } else {
+        index = find_store_child(node_ptr, *regex);
+        if (index < node_ptr->count && node_ptr->children[index]->key[0] == *regex) {
+          visit_store_matches(node_ptr->children[index], 1, regex + 1, 0, visit, arg);
+        }
+      }
+      break;
+  }
+}
+
+// **************************************************************************
+// send the stored message to the client
+static void send_stored_message(struct message *message_ptr, void *arg)
+{
+  struct replay         *replay_ptr;
+
+  // send the message if it is not empty or, if the subscriber knows an older version of the store, if it has
+  // changed since then (an empty message then tells the subscriber that the message was deleted), the payload
+  // must also pass the filter of the subscription
+  replay_ptr = (struct replay *)arg;
+  if ((replay_ptr->since ? message_ptr->version > replay_ptr->since : message_ptr->packet_ptr->payload_size > 0) &&
+      (!replay_ptr->subscribe_ptr->filter_ptr ||
+       match_filter(replay_ptr->subscribe_ptr->filter_ptr, message_ptr->packet_ptr->payload, message_ptr->packet_ptr->payload_size))) {
+    send_packet(replay_ptr->subscribe_ptr->client_ptr, message_ptr->packet_ptr);
+  }
+}
+
+// **************************************************************************
+// send all stored messages for the subscription changed after the given version of the store to the subscriber
+static void send_stored_messages(struct subscribe *subscribe_ptr, uint64_t since)
+{
+  struct replay         replay;
+
+  // visit all stored messages matching the topic
+  replay.subscribe_ptr = subscribe_ptr;
+  replay.since         = since;
+  visit_store_matches(&store_root, 0, subscribe_ptr->topic_ptr->name, 0, send_stored_message, &replay);
+}
+
+// **************************************************************************
+// load stored messages from the file of the persistent store (returns the size of its valid part)
+static size_t load_store_file(const char *path)
+{
+  struct message        *message_ptr;
+  struct packet         *packet_ptr;
+  struct record         record;
+  struct stat           st;
+  const char            *data;
+  const char            *topic;
+  uint64_t              now;
+  uint64_t              offset_time;
+  size_t                offset;
+  size_t                count;
+  size_t                size;
+  int                   fd;
+
+  // map the file
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return 0;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < XBUS_STORE_MAGIC_SIZE ||
+      (data = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  close(fd);
+
+  // check the identification of the file
+  if (memcmp(data, XBUS_STORE_MAGIC, XBUS_STORE_MAGIC_SIZE)) {
+    syslog(LOG_ERR, "file %s is not a store file", path);
+    munmap((void *)data, st.st_size);
+    return 0;
+  }
+
+  // get the current time and the offset between the real time clock and the monotonic clock
+  now         = get_time(CLOCK_REALTIME);
+  offset_time = now - get_time(CLOCK_MONOTONIC);
+
+  // store messages from all complete records (removed and expired messages are removed and their versions are lost)
+  offset = XBUS_STORE_MAGIC_SIZE;
+  count  = 0;
+  while (offset + sizeof(record) <= (size_t)st.st_size) {
+    memcpy(&record, data + offset, sizeof(record));
+    topic = data + offset + sizeof(record);
+    size  = record.payload_size == XBUS_RECORD_REMOVED ? 0 : record.payload_size;
+    if ((size_t)st.st_size - offset - sizeof(record) < (size_t)record.topic_size + size + 1 ||
+        !record.topic_size || topic[record.topic_size] || memchr(topic, '\0', record.topic_size)) {
+      break;
+    }
+    if (record.payload_size == XBUS_RECORD_REMOVED || (record.expires && record.expires <= now)) {
+      if ((message_ptr = find_stored_message(topic))) {
+        remove_stored_message(message_ptr);
+      }
+      if (store_floor < record.version) {
+        store_floor = record.version;
+      }
+    } else {
+      packet_ptr = create_packet(topic, topic + record.topic_size + 1, record.payload_size);
+      store_message(topic, packet_ptr, record.expires ? record.expires - offset_time : 0, record.version);
+      release_packet(packet_ptr);
+      if (store_version < record.version) {
+        store_version = record.version;
+      }
+    }
+    offset += sizeof(record) + record.topic_size + size + 1;
+    count++;
+  }
+
+  // write information to the log
+  if (offset < (size_t)st.st_size) {
+    syslog(LOG_WARNING, "file %s is truncated after %zu records", path, count);
+  }
+  debuglog("loaded %zu records from %s", count, path);
+
+  // unmap the file
+  munmap((void *)data, st.st_size);
+
+  // return the size of the valid part of the file
+  return offset;
+}
+
+// **************************************************************************
+// write data to the snapshot of the persistent store
+static void write_snapshot(struct snapshot *snapshot_ptr, const void *data, size_t size)
+{
+  const char            *ptr;
+  ssize_t               count;
+
+  // flush the buffer if the data does not fit into it
+  if (snapshot_ptr->length + size > sizeof(snapshot_ptr->buffer) || !data) {
+    for (ptr = snapshot_ptr->buffer; snapshot_ptr->length && !snapshot_ptr->failed; ptr += count) {
+      if ((count = write(snapshot_ptr->fd, ptr, snapshot_ptr->length)) < 0) {
+        snapshot_ptr->failed = 1;
+        break;
+      }
+      snapshot_ptr->length -= count;
+    }
+    snapshot_ptr->length = 0;
+  }
+
+  // write large data directly and copy other data to the buffer
+  if (size >= sizeof(snapshot_ptr->buffer)) {
+    for (ptr = (const char *)data; size && !snapshot_ptr->failed; ptr += count) {
+      if ((count = write(snapshot_ptr->fd, ptr, size)) < 0) {
+        snapshot_ptr->failed = 1;
+        break;
+      }
+      size                 -= count;
+      snapshot_ptr->size   += count;
+    }
+  } else if (data) {
+    memcpy(snapshot_ptr->buffer + snapshot_ptr->length, data, size);
+    snapshot_ptr->length += size;
+    snapshot_ptr->size   += size;
+  }
+}
+
+// **************************************************************************
+// collect the stored message for the compaction of the persistent store
+static void collect_stored_message(struct message *message_ptr, void *arg)
+{
+  struct compacted      *this_ptr;
+
+  // enlarge the array if necessary
+  (void)arg;
+  if (compacted_count == compacted_size) {
+    compacted_size = compacted_size ? 2 * compacted_size : 1024;
+    compacted      = (struct compacted *)safe_realloc(compacted, compacted_size * sizeof(*compacted));
+  }
+
+  // hold the topic and the packet of the message until the snapshot is written
+  this_ptr = &compacted[compacted_count++];
+  this_ptr->topic_ptr  = message_ptr->topic_ptr;
+  this_ptr->topic_ptr->refs++;
+  this_ptr->packet_ptr = hold_packet(message_ptr->packet_ptr);
+  this_ptr->expires    = message_ptr->timer.expires ? message_ptr->timer.expires + get_time(CLOCK_REALTIME) - get_time(CLOCK_MONOTONIC) : 0;
+  this_ptr->version    = message_ptr->version;
+}
+
+// **************************************************************************
+// write collected messages to a new snapshot which replaces the old one and the old journal (the lowest known version
+// of the store is kept by a removal record of the first message preceding the message itself)
+static int save_snapshot(void)
+{
+  struct compacted      *this_ptr;
+  struct record         record;
+  int                   fd;
+
+  // write all collected messages to a temporary file
+  if ((snapshot.fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+    syslog(LOG_ERR, "cannot create file %s: %s", temp_path, strerror(errno));
+    return -1;
+  }
+  snapshot.failed = 0;
+  snapshot.size   = 0;
+  snapshot.length = 0;
+  write_snapshot(&snapshot, XBUS_STORE_MAGIC, XBUS_STORE_MAGIC_SIZE);
+  if (compacted_count && compacted_floor) {
+    record.topic_size   = compacted->topic_ptr->length;
+    record.payload_size = XBUS_RECORD_REMOVED;
+    record.expires      = 0;
+    record.version      = compacted_floor;
+    write_snapshot(&snapshot, &record, sizeof(record));
+    write_snapshot(&snapshot, compacted->topic_ptr->name, record.topic_size + 1);
+  }
+  for (this_ptr = compacted; this_ptr < compacted + compacted_count; this_ptr++) {
+    record.topic_size   = this_ptr->topic_ptr->length;
+    record.payload_size = this_ptr->packet_ptr->payload_size;
+    record.expires      = this_ptr->expires;
+    record.version      = this_ptr->version;
+    write_snapshot(&snapshot, &record, sizeof(record));
+    write_snapshot(&snapshot, this_ptr->topic_ptr->name, record.topic_size + 1);
+    write_snapshot(&snapshot, this_ptr->packet_ptr->payload, record.payload_size);
+  }
+  write_snapshot(&snapshot, NULL, 0);
+
+  // make the file durable before it replaces the snapshot
+  if (snapshot.failed || fsync(snapshot.fd) != 0) {
+    syslog(LOG_ERR, "cannot write file %s: %s", temp_path, strerror(errno));
+    close(snapshot.fd);
+    unlink(temp_path);
+    return -1;
+  }
+  close(snapshot.fd);
+
+  // replace the snapshot (the journals only repeat its content until the old one is removed)
+  if (rename(temp_path, store_path) != 0) {
+    syslog(LOG_ERR, "cannot rename file %s: %s", temp_path, strerror(errno));
+    unlink(temp_path);
+    return -1;
+  }
+
+  // make the rename durable before the old journal is removed
+  if ((fd = open(directory_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 || fsync(fd) != 0) {
+    syslog(LOG_ERR, "cannot synchronize directory %s: %s", directory_path, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  close(fd);
+
+  // remove the old journal
+  if (unlink(old_journal_path) != 0 && errno != ENOENT) {
+    syslog(LOG_ERR, "cannot remove file %s: %s", old_journal_path, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// **************************************************************************
+// compact the persistent store (it runs in a separate thread which only reads the collected messages)
+static void *compact_store(void *arg)
+{
+  // write the snapshot and let the main thread finish the compaction
+  (void)arg;
+  compaction_failed = save_snapshot() != 0;
+  __atomic_store_n(&compaction_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+// **************************************************************************
+// release messages collected for the compaction of the persistent store and record its result
+static void finish_compaction(void)
+{
+  size_t                i;
+
+  // release topics and packets
+  for (i = 0; i < compacted_count; i++) {
+    release_topic(compacted[i].topic_ptr);
+    release_packet(compacted[i].packet_ptr);
+  }
+  compacted_count = 0;
+
+  // the old journal is no longer needed after a successful compaction
+  if (!compaction_failed) {
+    snapshot_size = snapshot.size;
+    old_journal   = 0;
+  }
+}
+
+// **************************************************************************
+// start the compaction of the persistent store (the journal is replaced by an empty one first unless an old journal
+// is still kept, so that it only contains writes which follow)
+static void start_compaction(void)
+{
+  // collect all stored messages and the lowest known version of the store
+  visit_store_subtree(&store_root, collect_stored_message, NULL);
+  compacted_floor = store_floor;
+
+  // replace the journal
+  if (!old_journal) {
+    if (rename(journal_path, old_journal_path) != 0) {
+      syslog(LOG_ERR, "cannot rename file %s: %s", journal_path, strerror(errno));
+      compaction_failed = 1;
+      finish_compaction();
+      return;
+    }
+    old_journal = 1;
+    close(journal_fd);
+    if ((journal_fd = open(journal_path, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0 ||
+        write(journal_fd, XBUS_STORE_MAGIC, XBUS_STORE_MAGIC_SIZE) != XBUS_STORE_MAGIC_SIZE) {
+      syslog(LOG_ERR, "cannot write file %s: %s", journal_path, strerror(errno));
+      if (journal_fd >= 0) {
+        close(journal_fd);
+      }
+      journal_fd = -1;
+    }
+    journal_size = XBUS_STORE_MAGIC_SIZE;
+  }
+
+  // write the snapshot in a separate thread (or at once if it cannot be started)
+  compaction_done = 0;
+  if ((errno = pthread_create(&compaction_thread, NULL, compact_store, NULL)) != 0) {
+    syslog(LOG_ERR, "pthread_create error: %s", strerror(errno));
+    compact_store(NULL);
+    finish_compaction();
+    return;
+  }
+  compaction_running = 1;
+}
+
+// **************************************************************************
+// start the compaction of the persistent store or finish it once the snapshot is written
+static void run_compaction(void)
+{
+  // start the compaction
+  if (!compaction_running) {
+    start_compaction();
+  } else if (__atomic_load_n(&compaction_done, __ATOMIC_ACQUIRE)) {
+    pthread_join(compaction_thread, NULL);
+    compaction_running = 0;
+    finish_compaction();
+  }
+
+  // check the thread again in the next tick
+  if (compaction_running) {
+    add_timer(&compaction_timer, get_time(CLOCK_MONOTONIC) + XBUS_TICK);
+  }
+}
+
+// **************************************************************************
+// append the stored message or its removal to the journal of the persistent store
+static void journal_message(struct message *message_ptr, int removed)
+{
+  struct record         record;
+  struct iovec          iov[3];
+  size_t                size;
+
+  // stop if the persistent store is not used
+  if (journal_fd < 0) {
+    return;
+  }
+
+  // assemble the record from the header, the topic, a null character and the payload (a removal has no payload)
+  record.topic_size   = message_ptr->topic_ptr->length;
+  record.payload_size = removed ? XBUS_RECORD_REMOVED : message_ptr->packet_ptr->payload_size;
+  record.expires      = message_ptr->timer.expires ? message_ptr->timer.expires + get_time(CLOCK_REALTIME) - get_time(CLOCK_MONOTONIC) : 0;
+  record.version      = message_ptr->version;
+  iov[0].iov_base = &record;
+  iov[0].iov_len  = sizeof(record);
+  iov[1].iov_base = message_ptr->topic_ptr->name;
+  iov[1].iov_len  = record.topic_size + 1;
+  iov[2].iov_base = message_ptr->packet_ptr->payload;
+  iov[2].iov_len  = removed ? 0 : record.payload_size;
+  size = sizeof(record) + iov[1].iov_len + iov[2].iov_len;
+
+  // append the record to the journal (a partially written record is cut off)
+  if (writev(journal_fd, iov, 3) != (ssize_t)size) {
+    syslog(LOG_ERR, "cannot write file %s: %s", journal_path, strerror(errno));
+    if (ftruncate(journal_fd, journal_size) != 0) {
+      syslog(LOG_ERR, "cannot truncate file %s: %s", journal_path, strerror(errno));
+    }
+    return;
+  }
+  journal_size += size;
+
+  // compact the persistent store once the journal outgrows the snapshot (the timer starts it outside of the dispatch
+  // of the message)
+  if (journal_size > XBUS_JOURNAL_SIZE && journal_size > snapshot_size && !compaction_timer.expires) {
+    add_timer(&compaction_timer, get_time(CLOCK_MONOTONIC));
+  }
+}
+
+// **************************************************************************
+// load stored messages from the persistent store and open its journal
+static void open_store(void)
+{
+  const char            *slash_ptr;
+  size_t                length;
+  size_t                size;
+
+  // compose names of the journals, the temporary file and the directory (including its trailing slash)
+  journal_path     = (char *)safe_alloc(strlen(store_path) + sizeof(".journal"));
+  old_journal_path = (char *)safe_alloc(strlen(store_path) + sizeof(".journal.old"));
+  temp_path        = (char *)safe_alloc(strlen(store_path) + sizeof(".tmp"));
+  sprintf(journal_path, "%s.journal", store_path);
+  sprintf(old_journal_path, "%s.journal.old", store_path);
+  sprintf(temp_path, "%s.tmp", store_path);
+  length         = (slash_ptr = strrchr(store_path, '/')) ? (size_t)(slash_ptr - store_path + 1) : 0;
+  directory_path = (char *)safe_alloc(length + sizeof("."));
+  sprintf(directory_path, "%.*s", (int)(length ? length : 1), length ? store_path : ".");
+
+  // load the snapshot and replay the journal left by an interrupted compaction and the journal (the old journal is
+  // kept until the next compaction)
+  snapshot_size = load_store_file(store_path);
+  old_journal   = access(old_journal_path, F_OK) == 0;
+  load_store_file(old_journal_path);
+  size          = load_store_file(journal_path);
+
+  // open the journal for appending
+  if ((journal_fd = open(journal_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+    syslog(LOG_ERR, "cannot open file %s: %s", journal_path, strerror(errno));
+    return;
+  }
+
+  // cut off an incomplete record at the end of the journal or start a new journal
+  if (size) {
+    if (ftruncate(journal_fd, size) != 0) {
+      syslog(LOG_ERR, "cannot truncate file %s: %s", journal_path, strerror(errno));
+    }
+  } else if (ftruncate(journal_fd, 0) != 0 || write(journal_fd, XBUS_STORE_MAGIC, XBUS_STORE_MAGIC_SIZE) != XBUS_STORE_MAGIC_SIZE) {
+    syslog(LOG_ERR, "cannot write file %s: %s", journal_path, strerror(errno));
+    close(journal_fd);
+    journal_fd = -1;
+    return;
+  }
+  journal_size = size ? size : XBUS_STORE_MAGIC_SIZE;
+}
+
+// **************************************************************************
+// remove least recently used stored messages until the limits of the store are met (the most recently used message
+// is always kept)
+static void evict_messages(void)
+{
+  struct message        *this_ptr;
+
+  // remove messages from the end of the list of recently used messages
+  while (lru_last_ptr != lru_first_ptr && ((store_count_limit && store_count > store_count_limit) ||
+                                            (store_size_limit && store_size > store_size_limit))) {
+    this_ptr = lru_last_ptr;
+
+    // write information to the log
+    debuglog("message \"%s\" evicted", this_ptr->topic_ptr->name);
+
+    // update statistics and forget changes up to the version of the message
+    evicted_count++;
+    evicted_size += this_ptr->size;
+    if (store_floor < this_ptr->version) {
+      store_floor = this_ptr->version;
+    }
+
+    // remove the message
+    journal_message(this_ptr, 1);
+    remove_stored_message(this_ptr);
+  }
+}
+
+// **************************************************************************
+// send the packet to the client whose subscription limits the rate of messages, or hold it back in the conflation slot
+// of its topic until the interval since the last delivery elapses (a newer packet replaces the held one)
+static void conflate_packet(struct client *client_ptr, const char *topic, struct packet *packet_ptr)
+{
+  struct conflation     *this_ptr;
+  struct topic          *topic_ptr;
+  uint64_t              now;
+
+  // intern the topic and find its slot in the hash table
+  topic_ptr = intern_topic(topic);
+  this_ptr  = find_slot(client_ptr, topic_ptr);
+
+  // use an existing slot or create a new one (the slot holds one reference to the topic)
+  if (this_ptr) {
+    release_topic(topic_ptr);
+  } else {
+    this_ptr = (struct conflation *)pool_alloc(&conflation_pool);
+    this_ptr->topic_ptr     = topic_ptr;
+    this_ptr->client_ptr    = client_ptr;
+    this_ptr->packet_ptr    = NULL;
+    this_ptr->sent          = 0;
+    this_ptr->timer.type    = TIMER_CONFLATION;
+    this_ptr->timer.expires = 0;
+    if (client_ptr->slot_count >= client_ptr->slot_table_size) {
+      resize_slot_table(client_ptr, client_ptr->slot_table_size ? 2 * client_ptr->slot_table_size : XBUS_SLOT_HASH_SIZE);
+    }
+    this_ptr->next_ptr = client_ptr->slot_table[topic_ptr->hash & (client_ptr->slot_table_size - 1)];
+    client_ptr->slot_table[topic_ptr->hash & (client_ptr->slot_table_size - 1)] = this_ptr;
+    client_ptr->slot_count++;
+  }
+  this_ptr->interval = client_ptr->interval;
+
+  // send the packet at once if the interval has elapsed and nothing is held back
+  now = get_time(CLOCK_MONOTONIC);
+  if (!this_ptr->packet_ptr && now >= this_ptr->sent + this_ptr->interval) {
+    this_ptr->sent = now;
+    send_packet(client_ptr, packet_ptr);
+    if (!this_ptr->timer.expires) {
+      add_timer(&this_ptr->timer, this_ptr->sent + this_ptr->interval);
+    }
+    return;
+  }
+
+  // hold the packet back instead of the previous one
+  if (this_ptr->packet_ptr) {
+    release_packet(this_ptr->packet_ptr);
+    client_ptr->conflated++;
+  }
+  this_ptr->packet_ptr = hold_packet(packet_ptr);
+
+  // send the packet once the interval elapses
+  if (!this_ptr->timer.expires) {
+    add_timer(&this_ptr->timer, this_ptr->sent + this_ptr->interval);
+  }
+}
+
+// **************************************************************************
+// send the message to all clients who have subscribed to the topic (the interned topic is known if the message was
+// published by an alias)
+static void dispatch_message(struct client *client_ptr, const char *topic, struct topic *topic_ptr, struct packet *packet_ptr)
+{
+  struct packet         *alias_ptr;
+  struct packet         *this_ptr;
+  int                   cached;
+  size_t                i;
+
+  // find all clients who have subscribed to the topic, use the cache of the topic published by an alias or find the
+  // interned topic if any client uses aliases (a payload in a memory file is always sent with the topic)
+  cached    = topic_ptr != NULL;
+  alias_ptr = NULL;
+  if (cached) {
+    find_cached_recipients(topic_ptr, packet_ptr);
+  } else {
+    topic_ptr = alias_total && packet_ptr->fd < 0 ? find_topic(topic) : NULL;
+    find_recipients(topic, packet_ptr);
+  }
+
+  // send the same packet to all recipients, clients who have registered the alias of the topic share a packet with it
+  // and clients with limited rate of messages may get it later
+  for (i = 0; i < recipients_count; i++) {
+    if (recipients[i] == client_ptr) {
+      continue;
+    }
+    if (topic_ptr && recipients[i]->alias_count &&
+        (cached ? recipients[i]->alias_mark == dispatch_mark : find_alias(recipients[i], topic_ptr->id) != NULL)) {
+      if (!alias_ptr) {
+        alias_ptr = create_alias_packet(packet_ptr, topic_ptr->id);
+      }
+      this_ptr = alias_ptr;
+    } else {
+      this_ptr = packet_ptr;
+    }
+    if (recipients[i]->interval) {
+      conflate_packet(recipients[i], topic, this_ptr);
+    } else {
+      discard_slot(recipients[i], topic);
+      send_packet(recipients[i], this_ptr);
+    }
+  }
+
+  // release the packet with the alias
+  if (alias_ptr) {
+    release_packet(alias_ptr);
+  }
+}
+
+// **************************************************************************
+// process the command PUBLISH (publish a message)
+static void process_publish(struct client *client_ptr, const char *topic, struct topic *topic_ptr, struct packet *packet_ptr)
+{
+  // write information to the log
+  debuglog("process %s published \"%s\"", get_name(client_ptr), topic);
+
+  // send the message to all clients who have subscribed to the topic
+  dispatch_message(client_ptr, topic, topic_ptr, packet_ptr);
+}
+
+// **************************************************************************
+// process the command WRITE (publish and store a message)
+static void process_write(struct client *client_ptr, const char *topic, struct topic *topic_ptr, struct packet *packet_ptr)
+{
+  struct message        *message_ptr;
+  uint64_t              expires;
+  size_t                size;
+
+  // write information to the log
+  debuglog("process %s wrote \"%s\"", get_name(client_ptr), topic);
+
+  // find the current version of the message and get the expiration time of the new one
+  message_ptr = topic_ptr ? topic_ptr->message_ptr : find_stored_message(topic);
+  expires     = client_ptr->write_ttl ? get_time(CLOCK_MONOTONIC) + client_ptr->write_ttl : 0;
+
+  // only refresh the expiration of the message if it has not changed and the client does not want to dispatch it
+  if (message_ptr && client_ptr->skip_unchanged && message_ptr->packet_ptr->payload_size == packet_ptr->payload_size &&
+      !memcmp(message_ptr->packet_ptr->payload, packet_ptr->payload, packet_ptr->payload_size)) {
+    if (message_ptr->timer.expires || expires) {
+      journal_message(store_message(topic, packet_ptr, expires, message_ptr->version), 0);
+    } else {
+      touch_message(message_ptr);
+    }
+    return;
+  }
+
+  // reject the message if a new record, the interned topic and up to two nodes of the radix tree do not fit into
+  // the memory budget (the packet itself is already charged)
+  if (memory_limit && !message_ptr) {
+    size = message_pool.size + get_arena_size(sizeof(struct topic) + strlen(topic) + 1) +
+           2 * (store_pool.size + get_arena_size(strlen(topic) + 1));
+    if (!check_budget(client_ptr, size)) {
+      send_error(client_ptr, OP_WRITE, topic, "out of memory");
+      return;
+    }
+  }
+
+  // send the message to all clients who have subscribed to the topic
+  dispatch_message(client_ptr, topic, topic_ptr, packet_ptr);
+
+  // store the packet of the message and make it persistent
+  journal_message(store_message(topic, packet_ptr, expires, ++store_version), 0);
+
+  // keep the store within its limits
+  evict_messages();
+}
+
+// **************************************************************************
+// replace the stored message whose time to live has elapsed by an empty one and notify its subscribers (the empty
+// message gets a new version like a deleted one, so that subscribers resuming from an older version learn about it,
+// and it is removed once its own time to live elapses)
+static void expire_message(struct message *this_ptr)
+{
+  struct packet         *packet_ptr;
+
+  // remove an empty message and forget changes up to its version
+  if (!this_ptr->packet_ptr->payload_size) {
+    if (store_floor < this_ptr->version) {
+      store_floor = this_ptr->version;
+    }
+    journal_message(this_ptr, 1);
+    remove_stored_message(this_ptr);
+    return;
+  }
+
+  // write information to the log
+  debuglog("message \"%s\" expired", this_ptr->topic_ptr->name);
+  expired_count++;
+
+  // notify subscribers by an empty message
+  packet_ptr = create_packet(this_ptr->topic_ptr->name, "", 0);
+  packet_ptr->header.flags |= FLAG_EXPIRED;
+  dispatch_message(NULL, this_ptr->topic_ptr->name, NULL, packet_ptr);
+
+  // store the empty message and make it persistent
+  journal_message(store_message(this_ptr->topic_ptr->name, packet_ptr, get_time(CLOCK_MONOTONIC) + XBUS_TOMBSTONE_TTL, ++store_version), 0);
+  release_packet(packet_ptr);
+}
+
+// **************************************************************************
+// send the packet held back in the conflation slot once the interval since the last delivery has elapsed, or destroy
+// the slot if nothing has arrived during the interval
+static void flush_slot(struct conflation *this_ptr)
+{
+  // destroy the idle slot
+  if (!this_ptr->packet_ptr) {
+    remove_slot(this_ptr);
+    return;
+  }
+
+  // send the packet and empty the slot
+  this_ptr->sent = get_time(CLOCK_MONOTONIC);
+  send_packet(this_ptr->client_ptr, this_ptr->packet_ptr);
+  release_packet(this_ptr->packet_ptr);
+  this_ptr->packet_ptr = NULL;
+
+  // destroy the slot if nothing arrives during the next interval
+  add_timer(&this_ptr->timer, this_ptr->sent + this_ptr->interval);
+}
+
+// **************************************************************************
+// append the text to the part of the list being built in the batch
+static void append_batch_data(struct batch *batch_ptr, const char *text, size_t length)
+{
+  // enlarge the buffer if necessary
+  if (batch_ptr->data_length + length > batch_ptr->data_size) {
+    discharge_memory(batch_ptr->data_size);
+    while (batch_ptr->data_length + length > batch_ptr->data_size) {
+      batch_ptr->data_size = batch_ptr->data_size ? 2 * batch_ptr->data_size : XBUS_MAX_SIZE;
+    }
+    batch_ptr->data = (char *)safe_realloc(batch_ptr->data, batch_ptr->data_size);
+    charge_memory(batch_ptr->data_size);
+  }
+
+  // append the text
+  memcpy(batch_ptr->data + batch_ptr->data_length, text, length);
+  batch_ptr->data_length += length;
+}
+
+// **************************************************************************
+// create the next part of the list of stored messages in the batch up to the given size (each topic is optionally
+// followed by a tab character and the size of the payload, and by the payload itself on the following line, the part
+// contains at least one message)
+static struct packet *create_list_packet(struct batch *batch_ptr, size_t limit)
+{
+  struct packet         *packet_ptr;
+  char                  size[32];
+  size_t                length;
+  int                   count;
+
+  // list messages until the part is full
+  batch_ptr->data_length = 0;
+  while (batch_ptr->index < batch_ptr->count) {
+    packet_ptr = batch_ptr->packets[batch_ptr->index];
+    count      = batch_ptr->details != LIST_TOPICS ? snprintf(size, sizeof(size), "\t%zu", packet_ptr->payload_size) : 0;
+    length     = packet_ptr->topic_size + count + 1 + (batch_ptr->details == LIST_VALUES ? packet_ptr->payload_size + 1 : 0);
+    if (batch_ptr->data_length && batch_ptr->data_length + length > limit) {
+      break;
+    }
+
+    // append the topic and the size of the payload if requested
+    append_batch_data(batch_ptr, packet_ptr->data, packet_ptr->topic_size);
+    append_batch_data(batch_ptr, size, count);
+    append_batch_data(batch_ptr, "\n", 1);
+
+    // append the payload if requested
+    if (batch_ptr->details == LIST_VALUES) {
+      append_batch_data(batch_ptr, packet_ptr->payload, packet_ptr->payload_size);
+      append_batch_data(batch_ptr, "\n", 1);
+    }
+    release_packet(packet_ptr);
+    batch_ptr->index++;
+  }
+
+  // create the packet
+  return create_packet("%list", batch_ptr->data, batch_ptr->data_length);
+}
+
+// **************************************************************************
+// send replies of batches to the client while its output queue has room, each batch is followed by the end-of-batch
+// marker "%end" with the number of its messages (sending is resumed in the next tick while the queue is full, a list
+// is sent in parts which are limited in size)
+static void send_batches(struct client *client_ptr)
+{
+  struct batch          *this_ptr;
+  struct packet         *packet_ptr;
+  struct packet         *reply_ptr;
+  char                  payload[32];
+  size_t                limit;
+  size_t                sent;
+
+  // packets handed off to the sending thread of the client are queued by the thread only after it is woken up,
+  // so they are counted here
+  limit = __atomic_load_n(&client_ptr->queue_limit, __ATOMIC_RELAXED);
+  sent  = 0;
+  while ((this_ptr = client_ptr->batch_ptr)) {
+
+    // send messages until the output queue becomes full
+    while (this_ptr->index < this_ptr->count) {
+      if (__atomic_load_n(&client_ptr->queue_count, __ATOMIC_RELAXED) + (client_ptr->worker_ptr ? sent : 0) >= limit) {
+        if (!client_ptr->batch_timer.expires) {
+          add_timer(&client_ptr->batch_timer, get_time(CLOCK_MONOTONIC) + XBUS_TICK);
+        }
+        return;
+      }
+
+      // the flag of the reply tells that more replies follow (the client may be closed by sending a message without
+      // the identifier, which also destroys the batch)
+      if (this_ptr->details == LIST_MESSAGES) {
+        packet_ptr = this_ptr->packets[this_ptr->index++];
+      } else {
+        packet_ptr = create_list_packet(this_ptr, XBUS_LIST_SIZE);
+      }
+      if (this_ptr->id) {
+        reply_ptr = create_reply_packet(packet_ptr, this_ptr->id, FLAG_BULK);
+        send_packet(client_ptr, reply_ptr);
+        release_packet(reply_ptr);
+      } else {
+        send_packet(client_ptr, packet_ptr);
+      }
+      release_packet(packet_ptr);
+      if (client_ptr->closed) {
+        return;
+      }
+      sent++;
+    }
+
+    // send the end-of-batch marker and destroy the batch
+    snprintf(payload, sizeof(payload), "%zu", this_ptr->count);
+    send_reply(client_ptr, "%end", payload, this_ptr->id);
+    client_ptr->batch_ptr = this_ptr->next_ptr;
+    free_batch(this_ptr);
+  }
+}
+
+// **************************************************************************
+// process all timers which have expired
+static void run_timers(void)
+{
+  struct timer          **list_ptr;
+  struct timer          *this_ptr;
+  uint64_t              expires;
+  uint64_t              now;
+  uint64_t              tick;
+  int                   level;
+
+  // skip elapsed ticks at once if no timer is scheduled
+  now = get_time(CLOCK_MONOTONIC);
+  if (!timer_count) {
+    timer_tick = now / XBUS_TICK + 1;
+    return;
+  }
+
+  // process all elapsed ticks
+  for (tick = now / XBUS_TICK; timer_tick <= tick; timer_tick++) {
+
+    // move timers from the slot of the higher level to lower levels whenever the lower level wraps around
+    for (level = 1; level < XBUS_WHEEL_LEVELS && !((timer_tick >> ((level - 1) * XBUS_WHEEL_BITS)) & ((1 << XBUS_WHEEL_BITS) - 1)); level++) {
+      list_ptr = &timer_wheel[level][(timer_tick >> (level * XBUS_WHEEL_BITS)) & ((1 << XBUS_WHEEL_BITS) - 1)];
+      while ((this_ptr = *list_ptr)) {
+        expires = this_ptr->expires;
+        remove_timer(this_ptr);
+        add_timer(this_ptr, expires);
+      }
+    }
+
+    // expire timers of the slot of the lowest level one by one, since expiring one timer may cancel others (too
+    // distant timers are only added again)
+    list_ptr = &timer_wheel[0][timer_tick & ((1 << XBUS_WHEEL_BITS) - 1)];
+    while ((this_ptr = *list_ptr)) {
+      expires = this_ptr->expires;
+      remove_timer(this_ptr);
+      if (expires > now) {
+        add_timer(this_ptr, expires);
+        continue;
+      }
+      switch (this_ptr->type) {
+        case TIMER_MESSAGE:
+          expire_message((struct message *)((char *)this_ptr - offsetof(struct message, timer)));
+          break;
+        case TIMER_CONFLATION:
+          flush_slot((struct conflation *)((char *)this_ptr - offsetof(struct conflation, timer)));
+          break;
+        case TIMER_COMPACTION:
+          run_compaction();
+          break;
+        case TIMER_BATCH:
+          send_batches((struct client *)((char *)this_ptr - offsetof(struct client, batch_timer)));
+          break;
+      }
+    }
+  }
+}
+
+// **************************************************************************
+// send statistics of all clients to the client
+static void send_statistics(struct client *client_ptr, unsigned long id)
+{
+  char                  payload[XBUS_MAX_SIZE];
+  struct client         *this_ptr;
+  size_t                length;
+  int                   size;
+
+  // prepare the message payload
+  payload[0] = '\0';
+  length     = 0;
+
+  // append one line for each client (only processes of the superuser see other clients)
+  for (this_ptr = first_client_ptr; this_ptr; this_ptr = this_ptr->next_ptr) {
+    if (this_ptr != client_ptr && client_ptr->cred.uid != 0) {
+      continue;
+    }
+    size = snprintf(payload + length, sizeof(payload) - length, "%d %s priority=%s queued=%zu dropped=%lu throttled=%lu rejected=%lu conflated=%lu\n",
+                    this_ptr->cred.pid, get_name(this_ptr), this_ptr->priority == PRIORITY_HIGH ? "high" : "normal",
+                    __atomic_load_n(&this_ptr->queue_count, __ATOMIC_RELAXED), __atomic_load_n(&this_ptr->dropped, __ATOMIC_RELAXED),
+                    this_ptr->throttled, this_ptr->rejected, this_ptr->conflated);
+    if (size < 0 || (size_t)size >= sizeof(payload) - length) {
+      payload[length] = '\0';
+      break;
+    }
+    length += size;
+  }
+
+  // send the packet to the client
+  send_reply(client_ptr, "%stats", payload, id);
+}
+
+// **************************************************************************
+// send statistics of the store to the client
+static void send_store_statistics(struct client *client_ptr, unsigned long id)
+{
+  char                  payload[256];
+
+  // prepare the message payload
+  snprintf(payload, sizeof(payload), "messages=%zu/%zu size=%zu/%zu evicted=%lu evicted_size=%lu expired=%lu\n",
+           store_count, store_count_limit, store_size, store_size_limit, evicted_count, evicted_size, expired_count);
+
+  // send the packet to the client
+  send_reply(client_ptr, "%store", payload, id);
+}
+
+// **************************************************************************
+// send the current version of the store to the client
+static void send_store_version(struct client *client_ptr, unsigned long id)
+{
+  char                  payload[32];
+
+  // prepare the message payload
+  snprintf(payload, sizeof(payload), "%llu", (unsigned long long)store_version);
+
+  // send the packet to the client
+  send_reply(client_ptr, "%version", payload, id);
+}
+
+// **************************************************************************
+// create a batch of replies to the request of the client with the correlation identifier
+static struct batch *create_batch(unsigned long id, int details)
+{
+  struct batch          *this_ptr;
+
+  // create a new record
+  this_ptr = (struct batch *)safe_alloc(sizeof(*this_ptr));
+  charge_memory(sizeof(*this_ptr));
+
+  // set the content of the new record (each batch has its own mark of collected messages)
+  this_ptr->id          = id;
+  this_ptr->details     = details;
+  this_ptr->filter_ptr  = NULL;
+  this_ptr->index       = 0;
+  this_ptr->count       = 0;
+  this_ptr->size        = 0;
+  this_ptr->packets     = NULL;
+  this_ptr->data        = NULL;
+  this_ptr->data_length = 0;
+  this_ptr->data_size   = 0;
+  this_ptr->next_ptr    = NULL;
+  batch_mark++;
+
+  // return a pointer to the new record
+  return this_ptr;
+}
+
+// **************************************************************************
+// add the stored message to the batch unless it is deleted, its payload does not pass the filter or it has been
+// already added for another topic of the request
+static void collect_batch_message(struct message *message_ptr, void *arg)
+{
+  struct batch          *batch_ptr;
+  struct packet         *packet_ptr;
+
+  // skip deleted, filtered and already collected messages
+  batch_ptr  = (struct batch *)arg;
+  packet_ptr = message_ptr->packet_ptr;
+  if (!packet_ptr->payload_size || message_ptr->mark == batch_mark ||
+      (batch_ptr->filter_ptr && !match_filter(batch_ptr->filter_ptr, packet_ptr->payload, packet_ptr->payload_size))) {
+    return;
+  }
+  message_ptr->mark = batch_mark;
+
+  // enlarge the array if necessary
+  if (batch_ptr->count == batch_ptr->size) {
+    charge_memory((batch_ptr->size ? batch_ptr->size : 64) * sizeof(*batch_ptr->packets));
+    batch_ptr->size    = batch_ptr->size ? 2 * batch_ptr->size : 64;
+    batch_ptr->packets = (struct packet **)safe_realloc(batch_ptr->packets, batch_ptr->size * sizeof(*batch_ptr->packets));
+  }
+
+  // hold the packet until it is sent (messages which are sent themselves are marked as recently used)
+  batch_ptr->packets[batch_ptr->count++] = hold_packet(packet_ptr);
+  if (batch_ptr->details == LIST_MESSAGES) {
+    touch_message(message_ptr);
+  }
+}
+
+// **************************************************************************
+// append the batch to the list of batches of the client and send as many replies as possible (replies are sent
+// only after replies to earlier batched requests)
+static void queue_batch(struct client *client_ptr, struct batch *batch_ptr)
+{
+  struct batch          **list_ptr;
+
+  // append the batch
+  list_ptr = &client_ptr->batch_ptr;
+  while (*list_ptr) {
+    list_ptr = &(*list_ptr)->next_ptr;
+  }
+  *list_ptr = batch_ptr;
+
+  // start sending
+  send_batches(client_ptr);
+}
+
+// **************************************************************************
+// send all stored messages matching any of the topics separated by newline characters (each message is sent once,
+// see send_batches())
+static void send_bulk_messages(struct client *client_ptr, const char *topics, unsigned long id)
+{
+  char                  topic[XBUS_MAX_SIZE];
+  struct batch          *batch_ptr;
+  size_t                length;
+
+  // collect all stored messages matching each topic (a topic which does not fit into a packet matches nothing)
+  batch_ptr = create_batch(id, LIST_MESSAGES);
+  for (; *topics; topics += length + (topics[length] == '\n')) {
+    length = strcspn(topics, "\n");
+    if (length && length < sizeof(topic)) {
+      memcpy(topic, topics, length);
+      topic[length] = '\0';
+      visit_store_matches(&store_root, 0, topic, 0, collect_batch_message, batch_ptr);
+    }
+  }
+
+  // send the messages
+  queue_batch(client_ptr, batch_ptr);
+}
+
+// **************************************************************************
+// process the command READ (read a stored message, the payload may contain the option "id=<identifier>" with
+// the correlation identifier of the reply and the option "bulk=1" which requests all stored messages matching
+// any of topics on the following lines of the payload or in the topic of old clients, see send_bulk_messages())
+static void process_read(struct client *client_ptr, const char *topic, const char *payload)
+{
+  struct message        *this_ptr;
+  const char            *ptr;
+  unsigned long         id;
+
+  // write information to the log
+  debuglog("process %s read \"%s\"", get_name(client_ptr), topic);
+
+  // get the correlation identifier
+  id = (ptr = find_option(payload, "id")) ? strtoul(ptr, NULL, 10) : 0;
+
+  // send all matching stored messages if requested
+  if ((ptr = find_option(payload, "bulk")) && *ptr == '1') {
+    send_bulk_messages(client_ptr, (ptr = strchr(payload, '\n')) ? ptr + 1 : topic, id);
+    return;
+  }
+
+  // send statistics if requested
+  if (!strcmp(topic, "%stats")) {
+    send_statistics(client_ptr, id);
+    return;
+  }
+
+  // send statistics of the store if requested
+  if (!strcmp(topic, "%store")) {
+    send_store_statistics(client_ptr, id);
+    return;
+  }
+
+  // send the version of the store if requested (all changes up to it are sent to subscribers before the reply)
+  if (!strcmp(topic, "%version")) {
+    send_store_version(client_ptr, id);
+    return;
+  }
+
+  // find a stored message according to the topic
+  this_ptr = find_stored_message(topic);
+
+  // send the stored message to the client and mark it as recently used
+  if (this_ptr) {
+    touch_message(this_ptr);
+    send_response(client_ptr, this_ptr->packet_ptr, id);
+  } else {
+    send_reply(client_ptr, topic, "", id);
+  }
+}
+
+// **************************************************************************
+// process the command SUBSCRIBE (subscribe to a topic, the payload may contain options "since=<version>" with
+// a version of the store known to the client so that only stored messages changed after it are sent,
+// "rate=<messages>" with the maximum number of messages on each topic per second, the latest message is always
+// delivered, and "filter=<filter>" with a filter of payloads, see create_filter())
+static void process_subscribe(struct client *client_ptr, const char *topic, const char *payload)
+{
+  struct subscribe      *this_ptr;
+  struct filter         *filter_ptr;
+  const char            *ptr;
+  char                  *end;
+  uint64_t              since;
+  unsigned long         rate;
+  size_t                size;
+  size_t                levels;
+
+  // write information to the log
+  debuglog("process %s subscribed to \"%s\" with options \"%s\"", get_name(client_ptr), topic, payload);
+
+  // reject the subscription if its rate of messages is invalid
+  rate = 0;
+  if ((ptr = find_option(payload, "rate")) &&
+      ((rate = strtoul(ptr, &end, 10)) == 0 || rate > XBUS_MAX_RATE || (*end && *end != ' '))) {
+    syslog(LOG_WARNING, "process %s subscribed with invalid rate \"%.*s\"", get_name(client_ptr), (int)strcspn(ptr, " "), ptr);
+    send_error(client_ptr, OP_SUBSCRIBE, topic, "invalid rate");
+    return;
+  }
+
+  // reject the subscription if its filter is invalid
+  filter_ptr = NULL;
+  if ((ptr = find_option(payload, "filter")) && !(filter_ptr = create_filter(ptr, strcspn(ptr, " ")))) {
+    syslog(LOG_WARNING, "process %s subscribed with invalid filter \"%s\"", get_name(client_ptr), ptr);
+    send_error(client_ptr, OP_SUBSCRIBE, topic, "invalid filter");
+    return;
+  }
+
+  // reject the subscription if a new record and a node of the subscription index for each level of the topic
+  // do not fit into the memory budget
+  if (memory_limit) {
+    for (ptr = topic, levels = 1; *ptr; ptr++) {
+      levels += *ptr == '/';
+    }
+    size = get_arena_size(strlen(topic) + 1);
+    if (!check_budget(client_ptr, subscribe_pool.size + get_arena_size(sizeof(struct topic) + strlen(topic) + 1) +
+                                  levels * (index_pool.size + size))) {
+      if (filter_ptr) {
+        arena_free(filter_ptr);
+      }
+      send_error(client_ptr, OP_SUBSCRIBE, topic, "out of memory");
+      return;
+    }
+  }
+
+  // create a new record
+  this_ptr = (struct subscribe *)pool_alloc(&subscribe_pool);
+
+  // set the content of the new record
+  this_ptr->topic_ptr  = intern_topic(topic);
+  this_ptr->client_ptr = client_ptr;
+  this_ptr->interval   = 0;
+  this_ptr->filter_ptr = filter_ptr;
+
+  // limit the rate of messages if requested
+  if (rate) {
+    this_ptr->interval = 1000 / rate;
+    client_ptr->limited_count++;
+  }
+
+  // add the new record to the list of subscribed topics
+  this_ptr->next_ptr        = client_ptr->subscribe_ptr;
+  client_ptr->subscribe_ptr = this_ptr;
+
+  // add the new record to the subscription index
+  index_subscription(this_ptr);
+
+  // send all stored messages for the topic to the client, all messages are sent after the message "%reset" if changes
+  // after the version may be lost or if the version is newer than the store (it comes from another history of the store)
+  since = (ptr = find_option(payload, "since")) ? strtoull(ptr, NULL, 10) : 0;
+  if (since && (since < store_floor || since > store_version)) {
+    send_reply(client_ptr, "%reset", topic, 0);
+    since = 0;
+  }
+  send_stored_messages(this_ptr, since);
+}
+
+// **************************************************************************
+// process the command UNSUBSCRIBE (unsubscribe from a topic)
+static void process_unsubscribe(struct client *client_ptr, const char *topic)
+{
+  struct subscribe      *prev_ptr;
+  struct subscribe      *this_ptr;
+  struct topic          *topic_ptr;
+
+  // stop if nobody has subscribed to the topic
+  if (!(topic_ptr = find_topic(topic))) {
+    return;
+  }
+
+  // find a subscription record according to the interned topic
+  prev_ptr = NULL;
+  this_ptr = client_ptr->subscribe_ptr;
+  while (this_ptr && this_ptr->topic_ptr != topic_ptr) {
+    prev_ptr = this_ptr;
+    this_ptr = this_ptr->next_ptr;
+  }
+
+  // stop if a subscription record was not found
+  if (!this_ptr) {
+    return;
+  }
+
+  // write information to the log
+  debuglog("process %s unsubscribed from \"%s\"", get_name(client_ptr), topic);
+
+  // remove an entry from the list of subscriptions
+  if (prev_ptr) {
+    prev_ptr->next_ptr = this_ptr->next_ptr;
+  } else {
+    client_ptr->subscribe_ptr = this_ptr->next_ptr;
+  }
+
+  // remove the record from the subscription index
+  unindex_subscription(this_ptr);
+
+  // discard conflation slots when the last subscription with limited rate of messages is removed
+  if (this_ptr->interval && !--client_ptr->limited_count) {
+    release_slots(client_ptr);
+  }
+
+  // free allocated memory
+  if (this_ptr->filter_ptr) {
+    arena_free(this_ptr->filter_ptr);
+  }
+  release_topic(this_ptr->topic_ptr);
+  pool_free(&subscribe_pool, this_ptr);
+}
+
+// **************************************************************************
+// process the command ALIAS (register a numeric alias of a topic)
+static void process_alias(struct client *client_ptr, const char *topic, const char *options)
+{
+  struct topic          *topic_ptr;
+  const char            *ptr;
+  char                  payload[16];
+  unsigned long         id;
+  size_t                index;
+
+  // write information to the log
+  debuglog("process %s registered alias of \"%s\"", get_name(client_ptr), topic);
+
+  // get the correlation identifier of the reply
+  id = (ptr = find_option(options, "id")) ? strtoul(ptr, NULL, 10) : 0;
+
+  // reject topic patterns and aliases which do not fit into the memory budget
+  if (strpbrk(topic, "+*") || !check_budget(client_ptr, get_arena_size(sizeof(struct topic) + strlen(topic) + 1))) {
+    send_reply(client_ptr, topic, "0", id);
+    return;
+  }
+
+  // intern the topic and find its position in the sorted array of aliases
+  topic_ptr = intern_topic(topic);
+  index     = find_alias_index(client_ptr, topic_ptr->id);
+
+  // add the topic to the array unless it is already there (the array holds one reference to the topic)
+  if (index < client_ptr->alias_count && client_ptr->aliases[index] == topic_ptr) {
+    release_topic(topic_ptr);
+  } else {
+    client_ptr->aliases = (struct topic **)safe_realloc(client_ptr->aliases, (client_ptr->alias_count + 1) * sizeof(*client_ptr->aliases));
+    memmove(&client_ptr->aliases[index + 1], &client_ptr->aliases[index], (client_ptr->alias_count - index) * sizeof(*client_ptr->aliases));
+    client_ptr->aliases[index] = topic_ptr;
+    client_ptr->alias_count++;
+    alias_total++;
+    cache_generation++;
+  }
+
+  // send the alias to the client (the identifier of the interned topic stays the same while it is referenced)
+  snprintf(payload, sizeof(payload), "%u", topic_ptr->id);
+  send_reply(client_ptr, topic, payload, id);
+}
+
+// **************************************************************************
+// process the command OPTION (set an option of the connection)
+static void process_option(struct client *client_ptr, const char *name, const char *value)
+{
+  long                  number;
+  char                  *end;
+  int                   policy;
+
+  // write information to the log
+  debuglog("process %s set option \"%s\" to \"%s\"", get_name(client_ptr), name, value);
+
+  // set the maximum number of packets in the output queue (it cannot exceed the limit set for the broker)
+  if (!strcmp(name, "queue-limit")) {
+    number = strtol(value, &end, 10);
+    if (end != value && !*end && number > 0) {
+      __atomic_store_n(&client_ptr->queue_limit, (size_t)number < queue_limit ? (size_t)number : queue_limit, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  // set the time to live of messages stored by the following writes in seconds (zero means forever, longer times
+  // than XBUS_MAX_TTL are invalid)
+  if (!strcmp(name, "write-ttl")) {
+    number = strtol(value, &end, 10);
+    if (end != value && !*end && number >= 0 && number <= XBUS_MAX_TTL) {
+      client_ptr->write_ttl = number * 1000UL;
+      return;
+    }
+  }
+
+  // set whether writes of unchanged messages are dispatched to subscribers
+  if (!strcmp(name, "skip-unchanged")) {
+    number = strtol(value, &end, 10);
+    if (end != value && !*end && (number == 0 || number == 1)) {
+      client_ptr->skip_unchanged = number;
+      return;
+    }
+  }
+
+  // set the overflow policy of the output queue
+  if (!strcmp(name, "queue-policy")) {
+    if ((policy = find_name(policy_names, value)) >= 0) {
+      __atomic_store_n(&client_ptr->policy, policy, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  // write information to the log if the option is invalid
+  syslog(LOG_WARNING, "process %s set invalid option \"%s\"", get_name(client_ptr), name);
+}
+
+// **************************************************************************
+// process the command LIST (read the list of stored messages matching the topic, the payload may contain options
+// "id=<identifier>" with the correlation identifier of the reply, "filter=<filter>" with a filter of payloads, see
+// create_filter(), "sizes=1" or "values=1" which add sizes of payloads or payloads themselves to the list, and
+// "parts=1" which sends the list in parts followed by the end-of-batch marker, see send_batches(), instead of
+// a single reply)
+static void process_list(struct client *client_ptr, const char *topic, const char *options)
+{
+  struct batch          *batch_ptr;
+  struct filter         *filter_ptr;
+  struct packet         *packet_ptr;
+  const char            *ptr;
+  unsigned long         id;
+  int                   details;
+
+  // write information to the log
+  debuglog("process %s listed \"%s\"", get_name(client_ptr), topic);
+
+  // get the correlation identifier
+  id = (ptr = find_option(options, "id")) ? strtoul(ptr, NULL, 10) : 0;
+
+  // get the filter (an invalid filter results in an empty list)
+  filter_ptr = NULL;
+  if ((ptr = find_option(options, "filter")) && !(filter_ptr = create_filter(ptr, strcspn(ptr, " ")))) {
+    syslog(LOG_WARNING, "process %s listed with invalid filter \"%s\"", get_name(client_ptr), ptr);
+    topic = NULL;
+  }
+
+  // get the requested details
+  details = LIST_TOPICS;
+  if ((ptr = find_option(options, "values")) && *ptr == '1') {
+    details = LIST_VALUES;
+  } else if ((ptr = find_option(options, "sizes")) && *ptr == '1') {
+    details = LIST_SIZES;
+  }
+
+  // collect all stored messages matching the topic
+  batch_ptr = create_batch(id, details);
+  if (topic) {
+    batch_ptr->filter_ptr = filter_ptr;
+    visit_store_matches(&store_root, 0, topic, 0, collect_batch_message, batch_ptr);
+    batch_ptr->filter_ptr = NULL;
+  }
+
+  // free the filter
+  if (filter_ptr) {
+    arena_free(filter_ptr);
+  }
+
+  // send the list in parts
+  if ((ptr = find_option(options, "parts")) && *ptr == '1') {
+    queue_batch(client_ptr, batch_ptr);
+    return;
+  }
+
+  // send the whole list in a single reply
+  packet_ptr = create_list_packet(batch_ptr, SIZE_MAX);
+  send_response(client_ptr, packet_ptr, id);
+  release_packet(packet_ptr);
+  free_batch(batch_ptr);
+}
+
+// **************************************************************************
+// process the command HELLO (negotiate the binary protocol)
+static void process_hello(struct client *client_ptr, int flags)
+{
+  struct packet         *packet_ptr;
+
+  // write information to the log
+  debuglog("process %s switched to binary protocol", get_name(client_ptr));
+
+  // use the binary protocol for all following packets (both flags are read by the sending thread of the client)
+  __atomic_store_n(&client_ptr->binary, 1, __ATOMIC_RELAXED);
+
+  // pass payloads in memory files as descriptors if the client can map them
+  __atomic_store_n(&client_ptr->memfd, (flags & FLAG_MEMFD) != 0, __ATOMIC_RELAXED);
+
+  // confirm the switch and the accepted capabilities to the client
+  packet_ptr = create_packet("xbus", "", 0);
+  packet_ptr->header.opcode = OP_HELLO;
+  packet_ptr->header.flags  = flags & FLAG_MEMFD;
+  send_packet(client_ptr, packet_ptr);
+  release_packet(packet_ptr);
+}
+
+// **************************************************************************
+// attach the shared ring buffer passed by the client
+static int attach_ring(struct client *client_ptr, int ring_fd, int event_fd)
+{
+  struct stat           st;
+  struct ring           *ring_ptr;
+  size_t                size;
+  int                   seals;
+
+  // only one ring buffer per connection of a binary client is allowed
+  if (!client_ptr->binary || client_ptr->ring_ptr || ring_fd < 0 || event_fd < 0) {
+    return -1;
+  }
+
+  // the client must not be able to shrink the ring buffer while it is mapped
+  seals = fcntl(ring_fd, F_GET_SEALS);
+  if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+    return -1;
+  }
+
+  // the capacity of the ring buffer must be a power of two within limits
+  if (fstat(ring_fd, &st) != 0 || (size_t)st.st_size < sizeof(*ring_ptr)) {
+    return -1;
+  }
+  size = st.st_size - sizeof(*ring_ptr);
+  if (size < XBUS_RING_MIN || size > XBUS_RING_MAX || (size & (size - 1))) {
+    return -1;
+  }
+
+  // map the ring buffer
+  if ((ring_ptr = (struct ring *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0)) == MAP_FAILED) {
+    return -1;
+  }
+
+  // monitor the notification descriptor
+  if (watch_ring(client_ptr, event_fd) != 0) {
+    munmap(ring_ptr, st.st_size);
+    return -1;
+  }
+
+  // the mapping stays valid after the memory file is closed
+  close(ring_fd);
+
+  // set the content of the client record
+  client_ptr->ring_ptr  = ring_ptr;
+  client_ptr->ring_size = size;
+  client_ptr->ring_head = __atomic_load_n(&ring_ptr->head, __ATOMIC_ACQUIRE);
+  client_ptr->ring_fd   = event_fd;
+
+  // return success
+  return 0;
+}
+
+// **************************************************************************
+// process the command RING (send packets through a shared ring buffer)
+static void process_ring(struct client *client_ptr, int ring_fd, int event_fd)
+{
+  struct packet         *packet_ptr;
+  const char            *result;
+
+  // attach the ring buffer
+  if (attach_ring(client_ptr, ring_fd, event_fd) == 0) {
+    debuglog("process %s attached ring buffer of %zu bytes", get_name(client_ptr), client_ptr->ring_size);
+    result = "accepted";
+  } else {
+    syslog(LOG_WARNING, "process %s sent invalid ring buffer", get_name(client_ptr));
+    if (ring_fd >= 0) {
+      close(ring_fd);
+    }
+    if (event_fd >= 0) {
+      close(event_fd);
+    }
+    result = "rejected";
+  }
+
+  // confirm the result to the client
+  packet_ptr = create_packet("xbus", result, strlen(result));
+  packet_ptr->header.opcode = OP_RING;
+  send_packet(client_ptr, packet_ptr);
+  release_packet(packet_ptr);
+}
+
+// **************************************************************************
+// process a message received from a client and release its packet (the interned topic is known if the message was
+// published by an alias)
+static void process_message(struct client *client_ptr, int opcode, const char *topic, struct topic *topic_ptr,
+                            struct packet *packet_ptr)
+{
+  // process the received message
+  if (opcode == OP_WRITE) {
+    process_write(client_ptr, topic, topic_ptr, packet_ptr);
+  } else {
+    process_publish(client_ptr, topic, topic_ptr, packet_ptr);
+  }
+
+  // release the packet
+  release_packet(packet_ptr);
+}
+
+// **************************************************************************
+// process a command received from a client (the topic of a message published by an alias is the name of its interned topic)
+static void process_command(struct client *client_ptr, int opcode, int flags, const char *topic, const char *payload, size_t size)
+{
+  // process the received command
+  switch (opcode) {
+    case OP_PUBLISH:
+    case OP_WRITE:
+      if (check_budget(client_ptr, get_arena_size(sizeof(struct packet) + strlen(topic) + size + 2))) {
+        process_message(client_ptr, opcode, topic, flags & FLAG_ALIAS ? (struct topic *)(topic - offsetof(struct topic, name)) : NULL,
+                        create_packet(topic, payload, size));
+      } else {
+        send_error(client_ptr, opcode, topic, "out of memory");
+      }
+      break;
+    case OP_READ:
+      process_read(client_ptr, topic, payload);
+      break;
+    case OP_SUBSCRIBE:
+      process_subscribe(client_ptr, topic, payload);
+      break;
+    case OP_UNSUBSCRIBE:
+      process_unsubscribe(client_ptr, topic);
+      break;
+    case OP_LIST:
+      process_list(client_ptr, topic, payload);
+      break;
+    case OP_OPTION:
+      process_option(client_ptr, topic, payload);
+      break;
+    case OP_HELLO:
+      process_hello(client_ptr, flags);
+      break;
+    case OP_ALIAS:
+      process_alias(client_ptr, topic, payload);
+      break;
+  }
+}
+
+// **************************************************************************
+// report the discarded fragmented message to the client (a request READ is answered with the end-of-batch marker
+// carrying the error so that the client does not wait for the reply, the correlation identifier is at the beginning
+// of the first part of the payload)
+static void reject_request(struct client *client_ptr, const struct header *header, const char *data, size_t size,
+                           const char *error)
+{
+  char                  options[32];
+  const char            *ptr;
+  unsigned long         id;
+  size_t                length;
+
+  // report a message
+  if (header->opcode == OP_PUBLISH || header->opcode == OP_WRITE) {
+    send_error(client_ptr, header->opcode, data, error);
+    return;
+  }
+
+  // copy the beginning of the payload
+  if (header->opcode != OP_READ || size <= (size_t)header->topic_size + 1) {
+    return;
+  }
+  length = size - header->topic_size - 1 < sizeof(options) ? size - header->topic_size - 1 : sizeof(options) - 1;
+  memcpy(options, data + header->topic_size + 1, length);
+  options[length] = '\0';
+
+  // send the reply
+  if ((ptr = find_option(options, "id")) && (id = strtoul(ptr, NULL, 10))) {
+    snprintf(options, sizeof(options), "error=%s", error);
+    send_reply(client_ptr, "%end", options, id);
+  }
+}
+
+// **************************************************************************
+// append a part of a fragmented message and process the message once it is complete
+static void assemble_message(struct client *client_ptr, const struct header *header, const char *data, size_t size)
+{
+  struct assembly       *this_ptr;
+  char                  *topic;
+
+  // start assembling a new message (a message which does not fit into the memory budget or cannot be allocated
+  // is discarded)
+  if (header->opcode != OP_CONTINUE) {
+    if (header->payload_size > message_limit) {
+      syslog(LOG_WARNING, "process %s sent too long message", get_name(client_ptr));
+      reject_request(client_ptr, header, data, size, "too long");
+      client_ptr->discarding = 1;
+      return;
+    }
+    if (!check_budget(client_ptr, get_assembly_size(header))) {
+      reject_request(client_ptr, header, data, size, "out of memory");
+      client_ptr->discarding = 1;
+      return;
+    }
+    if (!(this_ptr = (struct assembly *)malloc(get_assembly_size(header)))) {
+      syslog(LOG_ERR, "malloc error: %s", strerror(errno));
+      reject_request(client_ptr, header, data, size, "out of memory");
+      client_ptr->discarding = 1;
+      return;
+    }
+    charge_memory(get_assembly_size(header));
+    this_ptr->header = *header;
+    this_ptr->length = 0;
+    client_ptr->assembly_ptr = this_ptr;
+  }
+
+  // terminate processing if the part does not fit into the message
+  this_ptr = client_ptr->assembly_ptr;
+  if (this_ptr->length + size > this_ptr->header.topic_size + this_ptr->header.payload_size + 1 ||
+      (!(header->flags & FLAG_MORE) && this_ptr->length + size != this_ptr->header.topic_size + this_ptr->header.payload_size + 1)) {
+    syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+    free_assembly(this_ptr);
+    client_ptr->assembly_ptr = NULL;
+    return;
+  }
+
+  // append the part to the message
+  memcpy(this_ptr->data + this_ptr->length, data, size);
+  this_ptr->length += size;
+
+  // stop if more parts will follow
+  if (header->flags & FLAG_MORE) {
+    return;
+  }
+
+  // process the complete message
+  client_ptr->assembly_ptr = NULL;
+  topic = this_ptr->data;
+  topic[this_ptr->length] = '\0';
+  process_command(client_ptr, this_ptr->header.opcode, 0, topic, topic + this_ptr->header.topic_size + 1, this_ptr->header.payload_size);
+  free_assembly(this_ptr);
+}
+
+// **************************************************************************
+// check the structure of a binary packet
+static int check_binary_packet(struct client *client_ptr, const struct header *header, const char *topic, size_t length)
+{
+  // a continuation of a fragmented message contains only a null character and a part of the payload
+  if (header->opcode == OP_CONTINUE) {
+    return client_ptr->assembly_ptr && !header->topic_size && !*topic && length == (size_t)header->payload_size + 1;
+  }
+
+  // other packets contain the topic terminated by a null character
+  if (!header->topic_size || length <= header->topic_size || topic[header->topic_size] || strlen(topic) != header->topic_size) {
+    return 0;
+  }
+
+  // the first part of a fragmented message contains only the beginning of the payload
+  if (header->flags & FLAG_MORE) {
+    return length - header->topic_size - 1 <= header->payload_size;
+  }
+
+  // other packets contain the whole payload
+  return length - header->topic_size - 1 == header->payload_size;
+}
+
+// **************************************************************************
+// close received descriptors starting with the given one
+static void close_descriptors(int *fds, int first)
+{
+  int                   i;
+
+  // close the descriptors
+  for (i = first; i < XBUS_MAX_FDS; i++) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+}
+
+// **************************************************************************
+// map the sealed memory file with the payload of a message
+static char *map_payload(int fd, size_t size)
+{
+  struct stat           st;
+  char                  *payload;
+  int                   seals;
+
+  // the sender must not be able to shrink or modify the memory file
+  seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE)) {
+    return NULL;
+  }
+
+  // the memory file contains the payload terminated by a null character
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != size + 1) {
+    return NULL;
+  }
+
+  // map the memory file
+  if ((payload = (char *)mmap(NULL, size + 1, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    return NULL;
+  }
+
+  // check the terminating null character
+  if (payload[size]) {
+    munmap(payload, size + 1);
+    return NULL;
+  }
+
+  // return a pointer to the mapped payload
+  return payload;
+}
+
+// **************************************************************************
+// process a message whose payload is passed in a memory file
+static void process_memfd_packet(struct client *client_ptr, const struct header *header, const char *topic, size_t length, int fd)
+{
+  char                  *payload;
+
+  // terminate processing if the client sent a malformed packet
+  if ((header->opcode != OP_PUBLISH && header->opcode != OP_WRITE) || (header->flags & FLAG_MORE) || fd < 0 ||
+      !header->topic_size || length != (size_t)header->topic_size + 1 || strlen(topic) != header->topic_size) {
+    syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+
+  // terminate processing if the client sent a too long message
+  if (header->payload_size > message_limit) {
+    syslog(LOG_WARNING, "process %s sent too long message", get_name(client_ptr));
+    send_error(client_ptr, header->opcode, topic, "too long");
+    close(fd);
+    return;
+  }
+
+  // reject the message if the mapped payload and its packet do not fit into the memory budget
+  if (!check_budget(client_ptr, header->payload_size + 1 + get_arena_size(sizeof(struct packet) + header->topic_size + 1))) {
+    send_error(client_ptr, header->opcode, topic, "out of memory");
+    close(fd);
+    return;
+  }
+
+  // map the payload
+  if (!(payload = map_payload(fd, header->payload_size))) {
+    syslog(LOG_WARNING, "process %s sent invalid memory file", get_name(client_ptr));
+    close(fd);
+    return;
+  }
+
+  // process the message without copying its payload
+  process_message(client_ptr, header->opcode, topic, NULL, create_memfd_packet(topic, payload, header->payload_size, fd));
+}
+
+// **************************************************************************
+// process a binary packet received from a client
+static void process_binary_packet(struct client *client_ptr, char *buffer, size_t size, int *fds)
+{
+  struct header         header;
+  struct topic          *topic_ptr;
+  const char            *topic;
+  size_t                length;
+  int                   memfd;
+
+  // terminate processing if the client sent a too short packet
+  if (size < sizeof(header)) {
+    syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+    close_descriptors(fds, 0);
+    return;
+  }
+
+  // copy the header (the buffer does not need to be aligned)
+  memcpy(&header, buffer, sizeof(header));
+  topic  = buffer + sizeof(header);
+  length = size - sizeof(header);
+
+  // the flag of the packet HELLO only announces that the client can map memory files
+  memfd = header.opcode != OP_HELLO && (header.flags & FLAG_MEMFD);
+
+  // ignore descriptors which are not expected along with the packet
+  close_descriptors(fds, header.opcode == OP_RING ? 2 : memfd ? 1 : 0);
+
+  // skip remaining parts of a discarded message
+  if (header.opcode == OP_CONTINUE && client_ptr->discarding) {
+    client_ptr->discarding = header.flags & FLAG_MORE;
+    close_descriptors(fds, 0);
+    return;
+  }
+  client_ptr->discarding = 0;
+
+  // discard an incomplete fragmented message if another packet has arrived
+  if (client_ptr->assembly_ptr && header.opcode != OP_CONTINUE) {
+    syslog(LOG_WARNING, "process %s sent incomplete message", get_name(client_ptr));
+    free_assembly(client_ptr->assembly_ptr);
+    client_ptr->assembly_ptr = NULL;
+  }
+
+  // process a message whose payload is passed in a memory file
+  if (memfd) {
+    buffer[size] = '\0';
+    process_memfd_packet(client_ptr, &header, topic, length, fds[0]);
+    return;
+  }
+
+  // process a shared ring buffer and its notification descriptor
+  if (header.opcode == OP_RING) {
+    process_ring(client_ptr, fds[0], fds[1]);
+    return;
+  }
+
+  // process a message published by the alias of its topic (it contains a null character instead of the topic and
+  // the whole payload)
+  if (header.flags & FLAG_ALIAS) {
+    if ((header.opcode != OP_PUBLISH && header.opcode != OP_WRITE) || (header.flags & FLAG_MORE) || !length || *topic ||
+        length - 1 != header.payload_size || !(topic_ptr = find_alias(client_ptr, header.topic_size))) {
+      syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+      return;
+    }
+    buffer[size] = '\0';
+    process_command(client_ptr, header.opcode, header.flags, topic_ptr->name, topic + 1, header.payload_size);
+    return;
+  }
+
+  // terminate processing if the client sent a malformed packet
+  if (!check_binary_packet(client_ptr, &header, topic, length)) {
+    syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+    return;
+  }
+
+  // process a part of a fragmented message
+  if (header.opcode == OP_CONTINUE) {
+    assemble_message(client_ptr, &header, topic + 1, length - 1);
+    return;
+  }
+  if (header.flags & FLAG_MORE) {
+    assemble_message(client_ptr, &header, topic, length);
+    return;
+  }
+
+  // terminate the payload
+  buffer[size] = '\0';
+
+  // process the received command
+  process_command(client_ptr, header.opcode, header.flags, topic, topic + header.topic_size + 1, header.payload_size);
+}
+
+// **************************************************************************
+// process a packet received from a client
+static void process_packet(struct client *client_ptr, char *buffer, size_t size, int *fds)
+{
+  const char            *command;
+  const char            *topic;
+  const char            *payload;
+  int                   opcode;
+
+  // process a binary packet (a text packet never starts with a null character)
+  if (size < XBUS_MAX_SIZE && !buffer[0]) {
+    process_binary_packet(client_ptr, buffer, size, fds);
+    return;
+  }
+
+  // ignore descriptors attached to a text packet
+  close_descriptors(fds, 0);
+
+  // terminate processing if the client sent a too long packet
+  if (size == XBUS_MAX_SIZE) {
+    syslog(LOG_WARNING, "process %s sent too long packet", get_name(client_ptr));
+    return;
+  }
+
+  // terminate the content of the packet
+  buffer[size] = '\0';
+
+  // split the packet to parts
+  command = strtok(buffer, " \n");
+  topic   = strtok(NULL  , "\n" );
+  payload = strtok(NULL  , ""   );
+
+  // terminate processing if the client sent a malformed packet
+  if (!topic || !*topic) {
+   syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
+   return;
+  }
+
+  // fix empty payload
+  if (!payload) {
+    payload = "";
+  }
+
+  // translate the command to the operation code
+  if (!strcmp(command, "PUBLISH")) {
+    opcode = OP_PUBLISH;
+  } else if (!strcmp(command, "WRITE")) {
+    opcode = OP_WRITE;
+  } else if (!strcmp(command, "READ")) {
+    opcode = OP_READ;
+  } else if (!strcmp(command, "SUBSCRIBE")) {
+    opcode = OP_SUBSCRIBE;
+  } else if (!strcmp(command, "UNSUBSCRIBE")) {
+    opcode = OP_UNSUBSCRIBE;
+  } else if (!strcmp(command, "LIST")) {
+    opcode = OP_LIST;
+  } else if (!strcmp(command, "OPTION")) {
+    opcode = OP_OPTION;
+  } else {
+    return;
+  }
+
+  // process the received command
+  process_command(client_ptr, opcode, 0, topic, payload, strlen(payload));
+}
+
+// **************************************************************************
+// get descriptors received along with the packet (surplus descriptors are closed)
+static void get_descriptors(struct msghdr *msg, int *fds)
+{
+  struct cmsghdr        *cmsg;
+  size_t                count;
+  size_t                i;
+  int                   fd;
+
+  // no descriptor has been received yet
+  for (count = 0; count < XBUS_MAX_FDS; count++) {
+    fds[count] = -1;
+  }
+
+  // traverse the control messages
+  count = 0;
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    for (i = 0; CMSG_LEN((i + 1) * sizeof(int)) <= cmsg->cmsg_len; i++) {
+      memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (count < XBUS_MAX_FDS) {
+        fds[count++] = fd;
+      } else {
+        close(fd);
+      }
+    }
+  }
+}
+
+#ifndef XBUS_URING
+// **************************************************************************
+// close descriptors received along with packets which will not be processed
+static void discard_descriptors(struct mmsghdr *msgs, int count)
+{
+  int                   fds[XBUS_MAX_FDS];
+  int                   i;
+
+  // close descriptors of each packet
+  for (i = 0; i < count; i++) {
+    get_descriptors(&msgs[i].msg_hdr, fds);
+    close_descriptors(fds, 0);
+  }
+}
+#endif
+
+// **************************************************************************
+// receive and process packets from the shared ring buffer of a client until its quota is exhausted
+static void receive_ring(struct client *client_ptr, size_t *quota)
+{
+  struct ring           *ring_ptr;
+  unsigned long         work;
+  uint64_t              value;
+  uint32_t              length;
+  uint32_t              record;
+  uint32_t              offset;
+  uint32_t              tail;
+  uint32_t              size;
+  int                   fds[XBUS_MAX_FDS];
+  int                   i;
+
+  // the ring buffer is shared with the client, so its content must be validated after copying
+  ring_ptr = client_ptr->ring_ptr;
+  size     = client_ptr->ring_size;
+  tail     = __atomic_load_n(&ring_ptr->tail, __ATOMIC_ACQUIRE);
+
+  // process packets until the ring buffer is empty or the quota is exhausted
+  while (*quota) {
+
+    // go to sleep if the ring buffer is empty (the client wakes the broker up by the notification descriptor)
+    if (tail == client_ptr->ring_head) {
+      read(client_ptr->ring_fd, &value, sizeof(value));
+      __atomic_store_n(&ring_ptr->sleeping, 1, __ATOMIC_SEQ_CST);
+      tail = __atomic_load_n(&ring_ptr->tail, __ATOMIC_SEQ_CST);
+      if (tail == client_ptr->ring_head) {
+        break;
+      }
+      __atomic_store_n(&ring_ptr->sleeping, 0, __ATOMIC_RELAXED);
+    }
+
+    // get the next record (a zero length marks unused space at the end of the ring buffer)
+    offset = client_ptr->ring_head & (size - 1);
+    memcpy(&length, ring_ptr->data + offset, sizeof(length));
+    record = length ? (sizeof(length) + length + 3) & ~3U : size - offset;
+
+    // close the connection if the client has corrupted the ring buffer
+    if (tail - client_ptr->ring_head > size || record > tail - client_ptr->ring_head ||
+        offset + record > size || length >= XBUS_MAX_SIZE) {
+      syslog(LOG_WARNING, "process %s corrupted ring buffer", get_name(client_ptr));
+      close_client(client_ptr);
+      return;
+    }
+
+    // copy the packet and release the record
+    memcpy(receive_buffers[0], ring_ptr->data + offset + sizeof(length), length);
+    client_ptr->ring_head += record;
+    __atomic_store_n(&ring_ptr->head, client_ptr->ring_head, __ATOMIC_SEQ_CST);
+
+    // skip unused space
+    if (!length) {
+      continue;
+    }
+
+    // process the packet
+    for (i = 0; i < XBUS_MAX_FDS; i++) {
+      fds[i] = -1;
+    }
+    work = work_count;
+    process_packet(client_ptr, receive_buffers[0], length, fds);
+    if (client_ptr->closed) {
+      return;
+    }
+    work   = work_count - work + 1;
+    *quota = work < *quota ? *quota - work : 0;
+  }
+
+  // wake the client up if it waits for free space
+  if (__atomic_load_n(&ring_ptr->waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&ring_ptr->waiting, 0, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, &ring_ptr->head, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+
+  // the rest of the ring buffer will be processed in the next iteration
+  if (!*quota) {
+    value = 1;
+    write(client_ptr->ring_fd, &value, sizeof(value));
+  }
+}
+
+// **************************************************************************
+// check whether the shared ring buffer of the client contains unprocessed packets
+// (packets written just before the client has disconnected must not be lost)
+static int ring_pending(struct client *client_ptr)
 {
-  struct message        *prev_ptr;
-  struct message        *this_ptr;
-  size_t                size;
+  // compare positions of the client and the broker
+  return client_ptr->ring_ptr && __atomic_load_n(&client_ptr->ring_ptr->tail, __ATOMIC_ACQUIRE) != client_ptr->ring_head;
+}
 
-  // get length of the payload
-  size = strlen(payload);
+#ifndef XBUS_URING
+// **************************************************************************
+// receive and process packets from a client until its quota is exhausted
+static void receive_packets(struct client *client_ptr)
+{
+  struct mmsghdr        msgs[XBUS_BATCH_SIZE];
+  struct iovec          iovs[XBUS_BATCH_SIZE];
+  unsigned long         work;
+  size_t                quota;
+  int                   fds[XBUS_MAX_FDS];
+  int                   limit;
+  int                   count;
+  int                   i;
 
-  // find a record in the list of stored messages
-  prev_ptr = NULL;
-  this_ptr = first_message_ptr;
-  while (this_ptr && strcmp(this_ptr->topic, topic) < 0) {
-    prev_ptr = this_ptr;
-    this_ptr = this_ptr->next_ptr;
+  // prepare the buffers
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < XBUS_BATCH_SIZE; i++) {
+    iovs[i].iov_base = receive_buffers[i];
+    iovs[i].iov_len  = XBUS_MAX_SIZE;
+    msgs[i].msg_hdr.msg_iov    = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
   }
 
-  // update the content of an existing record if was found
-  if (this_ptr && !strcmp(this_ptr->topic, topic)) {
-    if (size > this_ptr->size) {
-      free(this_ptr->payload);
-      this_ptr->size    = size;
-      this_ptr->payload = safe_strdup(payload);
-    } else {
-      strcpy(this_ptr->payload, payload);
+  // each received packet and each packet queued as its consequence consume the quota
+  quota = client_quota;
+
+  // packets from the shared ring buffer precede packets sent over the socket
+  if (client_ptr->ring_ptr) {
+    receive_ring(client_ptr, &quota);
+    if (client_ptr->closed) {
+      return;
     }
-    return;
   }
 
-  // create a new record
-  this_ptr = (struct message *)safe_alloc(sizeof(*this_ptr));
+  // receive packets from the socket
+  while (quota) {
 
-  // set the content of the new record
-  this_ptr->size    = size;
-  this_ptr->topic   = safe_strdup(topic);
-  this_ptr->payload = safe_strdup(payload);
+    // reset the buffers for descriptors (their sizes are overwritten by each reception)
+    for (i = 0; i < XBUS_BATCH_SIZE; i++) {
+      msgs[i].msg_hdr.msg_control    = receive_controls[i].data;
+      msgs[i].msg_hdr.msg_controllen = sizeof(receive_controls[i].data);
+    }
 
-  // add the new record to the list of stored messages
-  if (prev_ptr) {
-    this_ptr->next_ptr = prev_ptr->next_ptr;
-    prev_ptr->next_ptr = this_ptr;
-  } else {
-    this_ptr->next_ptr = first_message_ptr;
-    first_message_ptr  = this_ptr;
+    // receive a batch of packets from the client
+    limit = quota < XBUS_BATCH_SIZE ? quota : XBUS_BATCH_SIZE;
+    count = recvmmsg(client_ptr->sk, msgs, limit, MSG_DONTWAIT | MSG_CMSG_CLOEXEC, NULL);
+
+    // a client which has closed the connection without reading all replies is reported as reset
+    // before the packets it has sent, so receive them anyway (the error is reported only once)
+    if (count < 0 && errno == ECONNRESET) {
+      continue;
+    }
+
+    // close the connection and destroy all client's record if the client has disconnected
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+      if (count == 0 && ring_pending(client_ptr)) {
+        return;
+      }
+      close_client(client_ptr);
+      return;
+    }
+
+    // stop if there is nothing to receive
+    if (count < 0) {
+      return;
+    }
+
+    // process the received packets (an empty packet means that the client has disconnected)
+    for (i = 0; i < count; i++) {
+      if (!msgs[i].msg_len) {
+        discard_descriptors(msgs + i, count - i);
+        if (!ring_pending(client_ptr)) {
+          close_client(client_ptr);
+        }
+        return;
+      }
+      work = work_count;
+      get_descriptors(&msgs[i].msg_hdr, fds);
+      process_packet(client_ptr, receive_buffers[i], msgs[i].msg_len, fds);
+      if (client_ptr->closed) {
+        discard_descriptors(msgs + i + 1, count - i - 1);
+        return;
+      }
+      work  = work_count - work + 1;
+      quota = work < quota ? quota - work : 0;
+    }
+
+    // stop if all pending packets have been received
+    if (count < limit) {
+      return;
+    }
   }
+
+  // the rest of pending packets will be received in the next iteration
+  client_ptr->throttled++;
 }
 
 // **************************************************************************
-// find a stored message according to the topic
-static struct message *find_stored_message(const char *topic)
+// accept all pending connections
+static void accept_clients(int sk_listen)
 {
-  struct message        *this_ptr;
+  int                   sk;
 
-  // find a record in the list of stored messages
-  this_ptr = first_message_ptr;
-  while (this_ptr && strcmp(this_ptr->topic, topic)) {
-    this_ptr = this_ptr->next_ptr;
+  // accept connections until the queue of pending connections is empty
+  while ((sk = accept4(sk_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    create_client(sk);
+    refusing = 0;
   }
 
-  // return a pointer to the record
-  return this_ptr;
+  // refuse the connection if descriptors ran out or write information to the log if another unexpected error
+  // occurred
+  if (errno == EMFILE || errno == ENFILE) {
+    refuse_client(sk_listen);
+  } else if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+    syslog(LOG_ERR, "accept error: %s", strerror(errno));
+  }
 }
+#endif
 
 // **************************************************************************
-// send all stored messages for the topic to the client
-static void send_stored_messages(struct client *client_ptr, const char *topic)
+// deliver packets handed off to the sending thread (returns nonzero if the thread can sleep)
+static int receive_handoffs(struct worker *worker_ptr)
 {
-  struct message        *this_ptr;
+  struct handoff        *handoff_ptr;
+  struct client         *client_ptr;
+  uint32_t              head;
+  uint32_t              tail;
+  size_t                count;
+  int                   idle;
 
-  // traverse the list of stored messages
-  this_ptr = first_message_ptr;
-  while (this_ptr) {
-    if (*this_ptr->payload && match_topic(this_ptr->topic, topic)) {
-      send_packet(client_ptr, this_ptr->topic, this_ptr->payload);
+  // process a limited number of packets, so that writable sockets are not starved
+  head = worker_ptr->head;
+  idle = 0;
+  for (count = 0; count < XBUS_HANDOFF_SIZE; count++) {
+
+    // announce that the thread is going to sleep and check the queue once more if it is empty
+    if ((tail = __atomic_load_n(&worker_ptr->tail, __ATOMIC_ACQUIRE)) == head) {
+      __atomic_store_n(&worker_ptr->sleeping, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&worker_ptr->tail, __ATOMIC_SEQ_CST) == head) {
+        idle = 1;
+        break;
+      }
+      __atomic_store_n(&worker_ptr->sleeping, 0, __ATOMIC_RELAXED);
     }
-    this_ptr = this_ptr->next_ptr;
+
+    // deliver the packet or move the record of the closed client to the list of closed clients
+    handoff_ptr = &worker_ptr->queue[head & (XBUS_HANDOFF_SIZE - 1)];
+    client_ptr  = handoff_ptr->client_ptr;
+    if (handoff_ptr->packet_ptr) {
+      deliver_packet(client_ptr, handoff_ptr->packet_ptr, &worker_ptr->flush_client_ptr);
+      release_packet(handoff_ptr->packet_ptr);
+    } else {
+      client_ptr->broken   = 1;
+      client_ptr->next_ptr = worker_ptr->closed_client_ptr;
+      worker_ptr->closed_client_ptr = client_ptr;
+    }
+
+    // release the entry
+    __atomic_store_n(&worker_ptr->head, ++head, __ATOMIC_RELEASE);
+  }
+
+  // wake the main thread up if it waits for free space
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&worker_ptr->waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&worker_ptr->waiting, 0, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, &worker_ptr->head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
   }
+
+  // the rest of handed off packets will be processed in the next iteration unless the queue is empty
+  return idle;
 }
 
 // **************************************************************************
-// send the message to the client if he has subscribed to the topic
-static void send_message(struct client *client_ptr, const char *topic, const char *payload)
+// the main function of a sending thread
+static void *run_worker(void *arg)
 {
-  struct subscribe      *this_ptr;
+  struct epoll_event    events[XBUS_MAX_EVENTS];
+  struct worker         *worker_ptr;
+  struct client         *client_ptr;
+  uint64_t              value;
+  int                   timeout;
+  int                   count;
+  int                   i;
 
-  // traverse the list of subscribed topics
-  this_ptr = client_ptr->subscribe_ptr;
-  while (this_ptr) {
-    if (match_topic(topic, this_ptr->topic)) {
-      send_packet(client_ptr, topic, payload);
-      break;
+  // the thread serves output queues of its clients only
+  worker_ptr = (struct worker *)arg;
+  timeout    = -1;
+
+  // the main loop of the thread
+  while (1) {
+
+    // wait for events
+    if ((count = epoll_wait(worker_ptr->epoll_fd, events, XBUS_MAX_EVENTS, timeout)) < 0) {
+      if (errno != EINTR) {
+        syslog(LOG_ERR, "epoll_wait error: %s", strerror(errno));
+      }
+      continue;
+    }
+
+    // process the events (the notification of handed off packets is identified by a null pointer)
+    for (i = 0; i < count; i++) {
+      if (!(client_ptr = (struct client *)events[i].data.ptr)) {
+        if (read(worker_ptr->event_fd, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN) {
+          syslog(LOG_ERR, "eventfd read error: %s", strerror(errno));
+        }
+        continue;
+      }
+      if (!client_ptr->broken) {
+        client_ptr->blocked = 0;
+        flush_queue(client_ptr);
+      }
+    }
+
+    // deliver handed off packets
+    timeout = receive_handoffs(worker_ptr) ? -1 : 0;
+
+    // send packets produced during processing of the handed off packets
+    flush_clients(&worker_ptr->flush_client_ptr);
+
+    // free records of closed clients
+    while ((client_ptr = worker_ptr->closed_client_ptr)) {
+      worker_ptr->closed_client_ptr = client_ptr->next_ptr;
+      destroy_client(client_ptr);
     }
-    this_ptr = this_ptr->next_ptr;
   }
+
+  // terminate the thread
+  return NULL;
 }
 
 // **************************************************************************
-// send the message to all clients who have subscribed to the topic
-static void dispatch_message(struct client *client_ptr, const char *topic, const char *payload)
+// start sending threads
+static void start_workers(size_t count)
 {
-  struct client         *this_ptr;
+  struct epoll_event    event;
+  struct worker         *worker_ptr;
+  size_t                i;
 
-  // traverse the list of clients
-  this_ptr = first_client_ptr;
-  while (this_ptr) {
-    if (this_ptr != client_ptr) {
-      send_message(this_ptr, topic, payload);
+  // create records of the threads
+  workers      = (struct worker *)safe_alloc(count * sizeof(*workers));
+  worker_count = count;
+
+  // start the threads
+  for (i = 0; i < count; i++) {
+    worker_ptr = &workers[i];
+    memset(worker_ptr, 0, sizeof(*worker_ptr));
+    worker_ptr->queue    = (struct handoff *)safe_alloc(XBUS_HANDOFF_SIZE * sizeof(*worker_ptr->queue));
+    worker_ptr->sleeping = 1;
+
+    // create the epoll instance and the notification of handed off packets
+    if ((worker_ptr->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      syslog(LOG_CRIT, "epoll_create error: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    if ((worker_ptr->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      syslog(LOG_CRIT, "eventfd error: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    // register the notification (identified by a null pointer)
+    event.events   = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(worker_ptr->epoll_fd, EPOLL_CTL_ADD, worker_ptr->event_fd, &event) != 0) {
+      syslog(LOG_CRIT, "epoll_ctl error: %s", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    // start the thread
+    if ((errno = pthread_create(&worker_ptr->thread, NULL, run_worker, worker_ptr)) != 0) {
+      syslog(LOG_CRIT, "pthread_create error: %s", strerror(errno));
+      exit(EXIT_FAILURE);
     }
-    this_ptr = this_ptr->next_ptr;
   }
 }
 
+#ifdef XBUS_URING
 // **************************************************************************
-// process the command PUBLISH (publish a message)
-static void process_publish(struct client *client_ptr, const char *topic, const char *payload)
+// process a packet received by the io_uring instance into a provided buffer
+static void complete_receive(struct client *client_ptr, struct io_uring_cqe *cqe_ptr)
 {
-  // write information to the log
-  debuglog("process %s published \"%s\"", get_name(client_ptr), topic);
+  struct buffer         *buffer_ptr;
+  struct msghdr         msg;
+  unsigned long         work;
+  unsigned int          index;
+  size_t                offset;
+  size_t                size;
+  char                  *data;
+  int                   fds[XBUS_MAX_FDS];
 
-  // send the message to all clients who have subscribed to the topic
-  dispatch_message(client_ptr, topic, payload);
-}
+  // the final completion ends the multishot operation
+  if (!(cqe_ptr->flags & IORING_CQE_F_MORE)) {
+    client_ptr->ops--;
+  }
 
-// **************************************************************************
-// process the command WRITE (publish and store a message)
-static void process_write(struct client *client_ptr, const char *topic, const char *payload)
-{
-  // write information to the log
-  debuglog("process %s wrote \"%s\"", get_name(client_ptr), topic);
+  // close the connection if the operation failed (running out of provided buffers is only temporary
+  // and a reset connection may still contain packets sent by the client)
+  if (!(cqe_ptr->flags & IORING_CQE_F_BUFFER)) {
+    if (cqe_ptr->res != -ENOBUFS && cqe_ptr->res != -EINTR && cqe_ptr->res != -ECONNRESET) {
+      close_client(client_ptr);
+    } else if (!(cqe_ptr->flags & IORING_CQE_F_MORE) && !client_ptr->closed) {
+      arm_receive(client_ptr);
+    }
+    return;
+  }
 
-  // send the message to all clients who have subscribed to the topic
-  dispatch_message(client_ptr, topic, payload);
+  // locate the descriptors and the packet in the buffer (the kernel fills in their actual sizes)
+  index      = cqe_ptr->flags >> IORING_CQE_BUFFER_SHIFT;
+  buffer_ptr = (struct buffer *)(uring.buffers + index * sizeof(struct buffer));
+  offset     = sizeof(buffer_ptr->header) + receive_msghdr.msg_namelen + receive_msghdr.msg_controllen;
+  data       = (char *)buffer_ptr + offset;
+  size       = (size_t)cqe_ptr->res > offset ? cqe_ptr->res - offset : 0;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_control    = (char *)buffer_ptr + sizeof(buffer_ptr->header) + receive_msghdr.msg_namelen;
+  msg.msg_controllen = buffer_ptr->header.controllen;
+  get_descriptors(&msg, fds);
+
+  // process the packet (an empty packet means that the client has disconnected)
+  if (client_ptr->closed) {
+    close_descriptors(fds, 0);
+  } else if (!size) {
+    close_descriptors(fds, 0);
+    if (ring_pending(client_ptr)) {
+      client_ptr->hangup = 1;
+    } else {
+      close_client(client_ptr);
+    }
+  } else {
+    work = work_count;
+    process_packet(client_ptr, data, size, fds);
+    work = work_count - work + 1;
+    client_ptr->quota = work < client_ptr->quota ? client_ptr->quota - work : 0;
+  }
 
-  // store the message
-  store_message(topic, payload);
+  // return the buffer and rearm the operation if it has ended prematurely
+  recycle_buffer(index);
+  if (!(cqe_ptr->flags & IORING_CQE_F_MORE) && !client_ptr->closed && !client_ptr->hangup) {
+    arm_receive(client_ptr);
+  }
 }
 
 // **************************************************************************
-// process the command READ (read a stored message)
-static void process_read(struct client *client_ptr, const char *topic)
+// process packets from the shared ring buffer announced by the notification descriptor
+static void complete_poll(struct client *client_ptr, struct io_uring_cqe *cqe_ptr)
 {
-  struct message        *this_ptr;
-
-  // write information to the log
-  debuglog("process %s read \"%s\"", get_name(client_ptr), topic);
+  // the final completion ends the multishot operation (the descriptor is closed once the ring buffer is detached)
+  if (!(cqe_ptr->flags & IORING_CQE_F_MORE)) {
+    client_ptr->ops--;
+    if (!client_ptr->ring_ptr) {
+      close(client_ptr->poll_fd);
+      client_ptr->poll_fd = -1;
+      return;
+    }
+    arm_poll(client_ptr);
+  }
 
-  // find a stored message according to the topic
-  this_ptr = find_stored_message(topic);
+  // stop if the client is closed or the notification has not been received
+  if (client_ptr->closed || !client_ptr->ring_ptr || cqe_ptr->res <= 0) {
+    return;
+  }
 
-  // send the stored message to the client
-  send_packet(client_ptr, topic, this_ptr ? this_ptr->payload : "");
+  // process packets from the ring buffer (the socket has been already closed by the client if it hung up)
+  receive_ring(client_ptr, &client_ptr->quota);
+  if (client_ptr->hangup && !client_ptr->closed && !ring_pending(client_ptr)) {
+    close_client(client_ptr);
+  }
 }
 
 // **************************************************************************
-// process the command SUBSCRIBE (subscribe to a topic)
-static void process_subscribe(struct client *client_ptr, const char *topic)
+// finish sending of a packet by the io_uring instance
+static void complete_send(struct client *client_ptr, struct io_uring_cqe *cqe_ptr)
 {
-  struct subscribe      *this_ptr;
+  struct transmit       *transmit_ptr;
+  int                   i;
 
-  // write information to the log
-  debuglog("process %s subscribed to \"%s\"", get_name(client_ptr), topic);
+  // the operation has finished
+  transmit_ptr = client_ptr->transmit_ptr;
+  client_ptr->ops--;
 
-  // create a new record
-  this_ptr = (struct subscribe *)safe_alloc(sizeof(*this_ptr));
+  // drop a too long packet, stop sending to a client which has closed the connection, close the connection on other errors
+  if (cqe_ptr->res == -EMSGSIZE) {
+    count_dropped(client_ptr);
+  } else if (cqe_ptr->res == -EPIPE || cqe_ptr->res == -ECONNRESET) {
+    client_ptr->broken = 1;
+  } else if (cqe_ptr->res < 0 && !client_ptr->broken) {
+    drop_client(client_ptr);
+  }
 
-  // set the content of the new record
-  this_ptr->topic = safe_strdup(topic);
+  // stop if other packets of the batch are still being sent
+  if (++transmit_ptr->done < transmit_ptr->count) {
+    return;
+  }
 
-  // add the new record to the list of subscribed topics
-  this_ptr->next_ptr        = client_ptr->subscribe_ptr;
-  client_ptr->subscribe_ptr = this_ptr;
+  // release the packets of the batch
+  for (i = 0; i < transmit_ptr->count; i++) {
+    release_packet(transmit_ptr->packets[i]);
+  }
+  transmit_ptr->count = 0;
+  transmit_ptr->done  = 0;
 
-  // send all stored messages for the topic to the client
-  send_stored_messages(client_ptr, topic);
+  // submit the next batch
+  if (!client_ptr->broken && client_ptr->queue_count) {
+    submit_queue(client_ptr);
+  }
 }
 
 // **************************************************************************
-// process the command UNSUBSCRIBE (unsubscribe from a topic)
-static void process_unsubscribe(struct client *client_ptr, const char *topic)
+// process the completion of an io_uring operation (returns nonzero if the completion is deferred to the next iteration)
+static int process_completion(struct io_uring_cqe *cqe_ptr, int sk_listen)
 {
-  struct subscribe      *prev_ptr;
-  struct subscribe      *this_ptr;
+  struct client         *client_ptr;
 
-  // find a subscription record according to the topic
-  prev_ptr = NULL;
-  this_ptr = client_ptr->subscribe_ptr;
-  while (this_ptr && strcmp(this_ptr->topic, topic)) {
-    prev_ptr = this_ptr;
-    this_ptr = this_ptr->next_ptr;
+  // identify the operation
+  client_ptr = (struct client *)(uintptr_t)(cqe_ptr->user_data & ~(uint64_t)TAG_MASK);
+  switch (cqe_ptr->user_data & TAG_MASK) {
+    case TAG_ACCEPT:
+      if (cqe_ptr->res >= 0) {
+        create_client(cqe_ptr->res);
+        refusing = 0;
+      } else if (cqe_ptr->res == -EMFILE || cqe_ptr->res == -ENFILE) {
+        refuse_client(sk_listen);
+      } else if (cqe_ptr->res != -EINTR && cqe_ptr->res != -ECONNABORTED) {
+        syslog(LOG_ERR, "accept error: %s", strerror(-cqe_ptr->res));
+      }
+      if (!(cqe_ptr->flags & IORING_CQE_F_MORE)) {
+        arm_accept(sk_listen);
+      }
+      return 0;
+    case TAG_SEND:
+      complete_send(client_ptr, cqe_ptr);
+      return 0;
+    case TAG_RECEIVE:
+    case TAG_POLL:
+      break;
+    default:
+      return 0;
   }
 
-  // stop if a subscription record was not found
-  if (!this_ptr) {
-    return;
+  // renew the processing quota of the client in each iteration of the main loop
+  if (client_ptr->round != round_count) {
+    client_ptr->round = round_count;
+    client_ptr->quota = client_quota;
   }
 
-  // write information to the log
-  debuglog("process %s unsubscribed from \"%s\"", get_name(client_ptr), topic);
+  // defer the completion if the quota is exhausted (completions of a closed client only release resources)
+  if (!client_ptr->quota && !client_ptr->closed) {
+    if (!client_ptr->deferred) {
+      client_ptr->throttled++;
+    }
+    return 1;
+  }
 
-  // remove an entry from the list of subscriptions
-  if (prev_ptr) {
-    prev_ptr->next_ptr = this_ptr->next_ptr;
+  // process the received packets
+  if ((cqe_ptr->user_data & TAG_MASK) == TAG_RECEIVE) {
+    complete_receive(client_ptr, cqe_ptr);
   } else {
-    client_ptr->subscribe_ptr = this_ptr->next_ptr;
+    complete_poll(client_ptr, cqe_ptr);
   }
-
-  // free allocated memory
-  free(this_ptr->topic);
-  free(this_ptr);
+  return 0;
 }
 
 // **************************************************************************
-// process the command LIST (read the list of stored messages)
-static void process_list(struct client *client_ptr)
+// append new completions of io_uring operations to the deferred ones
+static void collect_completions(void)
 {
-  char                  payload[XBUS_MAX_SIZE];
-  struct message        *this_ptr;
+  unsigned int          head;
+  unsigned int          tail;
 
-  // prepare the message payload
-  payload[0] = '\0';
+  // get the range of new entries of the completion queue
+  head = *uring.cq_head_ptr;
+  tail = __atomic_load_n(uring.cq_tail_ptr, __ATOMIC_ACQUIRE);
 
-  // traverse the list of stored messages
-  this_ptr = first_message_ptr;
-  while (this_ptr && strlen(payload) + strlen(this_ptr->topic) < sizeof(payload) - 8) {
-    strcat(payload, this_ptr->topic);
-    strcat(payload, "\n");
-    this_ptr = this_ptr->next_ptr;
+  // enlarge the array of completions if necessary
+  if (completion_count + (tail - head) > completion_size) {
+    completion_size = completion_count + (tail - head);
+    completions     = (struct io_uring_cqe *)safe_realloc(completions, completion_size * sizeof(*completions));
   }
 
-  // send the packet to the client
-  send_packet(client_ptr, "%list", payload);
+  // copy the entries and release them
+  while (head != tail) {
+    completions[completion_count++] = uring.cqes[head++ & uring.cq_mask];
+  }
+  __atomic_store_n(uring.cq_head_ptr, head, __ATOMIC_RELEASE);
 }
 
 // **************************************************************************
-// receive and process a packet from a client
-static void receive_packet(struct client *client_ptr)
+// the main loop driven by the io_uring instance
+static void run_uring(int sk_listen)
 {
-  char                  buffer[XBUS_MAX_SIZE];
-  const char            *command;
-  const char            *topic;
-  const char            *payload;
-  ssize_t               size;
+  struct client         *client_ptr;
+  size_t                deferred;
+  size_t                i;
+  int                   priority;
 
-  // receive a packet from the client
-  size = recv(client_ptr->sk, buffer, sizeof(buffer), MSG_DONTWAIT | MSG_NOSIGNAL);
+  while (1) {
 
-  // close the connection and destroy all client's record if the client has disconnected
-  if (size <= 0) {
-    close(client_ptr->sk);
-    destroy_client(client_ptr->sk);
-    return;
-  }
+    // submit prepared operations and wait for completions unless some completions have been deferred
+    deferred = completion_count;
+    enter_uring(deferred ? 0 : 1, get_timer_timeout());
+    collect_completions();
+    round_count++;
 
-  // terminate processing if the client sent a too long packet
-  if (size == sizeof(buffer)) {
-    syslog(LOG_WARNING, "process %s sent too long packet", get_name(client_ptr));
-    return;
-  }
+    // process the completions of clients with high priority first (processed completions are cleared)
+    for (priority = PRIORITY_HIGH; priority >= PRIORITY_NORMAL; priority--) {
+      for (i = 0; i < completion_count; i++) {
+        if (!completions[i].user_data) {
+          continue;
+        }
+        client_ptr = (struct client *)(uintptr_t)(completions[i].user_data & ~(uint64_t)TAG_MASK);
+        if ((client_ptr ? client_ptr->priority : PRIORITY_NORMAL) != priority) {
+          continue;
+        }
+        if (i < deferred) {
+          client_ptr->deferred--;
+        }
+        if (process_completion(&completions[i], sk_listen)) {
+          client_ptr->deferred++;
+        } else {
+          completions[i].user_data = 0;
+        }
+      }
+    }
 
-  // terminate the content of the packet
-  buffer[size] = '\0';
+    // keep deferred completions in order for the next iteration
+    deferred = 0;
+    for (i = 0; i < completion_count; i++) {
+      if (completions[i].user_data) {
+        completions[deferred++] = completions[i];
+      }
+    }
+    completion_count = deferred;
 
-  // split the packet to parts
-  command = strtok(buffer, " \n");
-  topic   = strtok(NULL  , "\n" );
-  payload = strtok(NULL  , ""   );
+    // process expired timers
+    run_timers();
 
-  // terminate processing if the client sent a malformed packet
-  if (!topic || !*topic) {
-   syslog(LOG_WARNING, "process %s sent malformed packet", get_name(client_ptr));
-   return;
-  }
+    // send packets produced during processing of the completions
+    flush_clients(&flush_client_ptr);
+
+    // free records of clients closed during processing of the completions
+    free_closed_clients();
+
+    // wake up sending threads with handed off packets
+    notify_workers();
 
-  // fix empty payload
-  if (!payload) {
-    payload = "";
   }
+}
+#else
+// **************************************************************************
+// the main loop driven by the epoll instance
+static void run_epoll(int sk_listen)
+{
+  struct epoll_event    events[XBUS_MAX_EVENTS];
+  struct client         *client_ptr;
+  int                   priority;
+  int                   count;
+  int                   i;
+
+  while (1) {
+
+    // wait for events until the next timer expires
+    if ((count = epoll_wait(epoll_fd, events, XBUS_MAX_EVENTS, get_timer_timeout())) < 0) {
+      if (errno != EINTR) {
+        syslog(LOG_ERR, "epoll_wait error: %s", strerror(errno));
+      }
+      continue;
+    }
+
+    // process the events of clients with high priority first
+    for (priority = PRIORITY_HIGH; priority >= PRIORITY_NORMAL; priority--) {
+      for (i = 0; i < count; i++) {
+        if (!(client_ptr = (struct client *)events[i].data.ptr)) {
+          if (priority == PRIORITY_NORMAL) {
+            accept_clients(sk_listen);
+          }
+          continue;
+        }
+        if (client_ptr->priority != priority) {
+          continue;
+        }
+        if (!client_ptr->closed && (events[i].events & EPOLLOUT)) {
+          client_ptr->blocked = 0;
+          flush_queue(client_ptr);
+        }
+        if (!client_ptr->closed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+          receive_packets(client_ptr);
+        }
+      }
+    }
+
+    // process expired timers
+    run_timers();
+
+    // send packets produced during processing of the events
+    flush_clients(&flush_client_ptr);
+
+    // free records of clients closed during processing of the events
+    free_closed_clients();
+
+    // wake up sending threads with handed off packets
+    notify_workers();
 
-  // process the received command
-  if (!strcmp(command, "PUBLISH")) {
-    process_publish(client_ptr, topic, payload);
-  } else if (!strcmp(command, "WRITE")) {
-    process_write(client_ptr, topic, payload);
-  } else if (!strcmp(command, "READ")) {
-    process_read(client_ptr, topic);
-  } else if (!strcmp(command, "SUBSCRIBE")) {
-    process_subscribe(client_ptr, topic);
-  } else if (!strcmp(command, "UNSUBSCRIBE")) {
-    process_unsubscribe(client_ptr, topic);
-  } else if (!strcmp(command, "LIST")) {
-    process_list(client_ptr);
   }
 }
+#endif
+
+// **************************************************************************
+// print help and terminate the program
+static void usage(const char *name)
+{
+  // print help
+  fprintf(stderr, "Usage: %s [options]\n"
+                  "\n"
+                  "Options:\n"
+                  "  -m <bytes>       maximum size of a message payload (default %d)\n"
+                  "  -q <packets>     maximum number of packets in the output queue of a client (default %d)\n"
+                  "  -o <policy>      output queue overflow policy: drop-newest (default), drop-oldest, disconnect\n"
+                  "  -b <packets>     processing quota of a client per iteration of the main loop (default %d)\n"
+                  "  -p <process>     serve the process with high priority (may be repeated)\n"
+                  "  -u <user>        serve processes of the user with high priority (may be repeated)\n"
+                  "  -t <threads>     number of threads sending packets to clients (default 0 = the main thread)\n"
+                  "  -s <file>        persistent store of written messages (a journal <file>.journal is kept next to it\n"
+                  "                   and the directory must be writable by the user daemon)\n"
+                  "  -M <bytes>       memory budget of records, strings, packets and buffers, PUBLISH, WRITE and SUBSCRIBE\n"
+                  "                   fail beyond it (default 0 = unlimited)\n"
+                  "  -n <messages>    maximum number of stored messages, least recently used ones are evicted beyond it\n"
+                  "                   (default 0 = unlimited)\n"
+                  "  -N <bytes>       maximum size of stored messages, least recently used ones are evicted beyond it\n"
+                  "                   (default 0 = unlimited)\n",
+                  basename(name), XBUS_MAX_MESSAGE, XBUS_QUEUE_SIZE, XBUS_QUOTA);
+
+  // terminate the program
+  exit(EXIT_FAILURE);
+}
 
 // **************************************************************************
 // the main function
-int main(void)
+int main(int argc, char **argv)
 {
   struct passwd         *pw_ptr;
-  struct client         *this_ptr;
-  struct client         *next_ptr;
-  fd_set                read_fd_set;
+  long                  number;
+  size_t                threads;
   int                   sk_listen;
-  int                   sk_temp;
-  int                   sk_max;
+  int                   opt;
+
+  // process command line options
+  threads = 0;
+  while ((opt = getopt(argc, argv, "m:q:o:b:p:u:t:s:M:n:N:")) != -1) {
+    switch (opt) {
+      case 'm':
+        if ((number = atol(optarg)) <= 0) {
+          usage(argv[0]);
+        }
+        message_limit = number;
+        break;
+      case 'q':
+        if ((number = atol(optarg)) <= 0) {
+          usage(argv[0]);
+        }
+        queue_limit = number;
+        break;
+      case 'o':
+        if ((queue_policy = find_name(policy_names, optarg)) < 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'b':
+        if ((number = atol(optarg)) <= 0) {
+          usage(argv[0]);
+        }
+        client_quota = number;
+        break;
+      case 'p':
+        priority_processes = (const char **)safe_realloc(priority_processes, (priority_process_count + 1) * sizeof(*priority_processes));
+        priority_processes[priority_process_count++] = optarg;
+        break;
+      case 'u':
+        if ((pw_ptr = getpwnam(optarg))) {
+          number = pw_ptr->pw_uid;
+        } else if ((number = atol(optarg)) <= 0 && strcmp(optarg, "0")) {
+          usage(argv[0]);
+        }
+        priority_users = (uid_t *)safe_realloc(priority_users, (priority_user_count + 1) * sizeof(*priority_users));
+        priority_users[priority_user_count++] = number;
+        break;
+      case 't':
+        if ((number = atol(optarg)) < 0 || number > XBUS_MAX_WORKERS || (number == 0 && strcmp(optarg, "0"))) {
+          usage(argv[0]);
+        }
+        threads = number;
+        break;
+      case 's':
+        store_path = optarg;
+        break;
+      case 'M':
+        if ((number = atol(optarg)) < 0 || (number == 0 && strcmp(optarg, "0"))) {
+          usage(argv[0]);
+        }
+        memory_limit = number;
+        break;
+      case 'n':
+        if ((number = atol(optarg)) < 0 || (number == 0 && strcmp(optarg, "0"))) {
+          usage(argv[0]);
+        }
+        store_count_limit = number;
+        break;
+      case 'N':
+        if ((number = atol(optarg)) < 0 || (number == 0 && strcmp(optarg, "0"))) {
+          usage(argv[0]);
+        }
+        store_size_limit = number;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
 
   // create a new session
   setsid();
 
-  // open the system log
-  openlog("xbusd", LOG_PID, LOG_DAEMON);
+  // open the system log (the connection is opened immediately, so that logging works when descriptors run out)
+  openlog("xbusd", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+
+  // start the timer wheel and the version counter of stored messages
+  timer_tick    = get_time(CLOCK_MONOTONIC) / XBUS_TICK;
+  store_version = get_time(CLOCK_REALTIME) * 1000;
+
+  // load stored messages from the persistent store (changes before the start are lost without it)
+  if (store_path) {
+    open_store();
+    evict_messages();
+  } else {
+    store_floor = store_version;
+  }
 
-  // open the UNIX socket
+  // open the UNIX socket and the spare descriptor
   sk_listen = open_unix_socket(XBUS_SOCKET);
+  spare_fd  = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+  // create the event engine and register the listening socket
+#ifdef XBUS_URING
+  setup_uring(sk_listen);
+#else
+  setup_epoll(sk_listen);
+#endif
 
   // drop privileges if possible
   pw_ptr = getpwnam("daemon");
@@ -616,49 +6625,18 @@ int main(void)
     }
   }
 
-  // the main loop
-  while (1) {
-
-    // assemble a set of sockets
-    FD_ZERO(&read_fd_set);
-    FD_SET(sk_listen, &read_fd_set);
-    sk_max = sk_listen;
-    this_ptr = first_client_ptr;
-    while (this_ptr) {
-      FD_SET(this_ptr->sk, &read_fd_set);
-      if (this_ptr->sk > sk_max) {
-        sk_max = this_ptr->sk;
-      }
-      this_ptr = this_ptr->next_ptr;
-    }
-
-    // wait for an event
-    if (select(sk_max + 1, &read_fd_set, NULL, NULL, NULL) < 0) {
-      syslog(LOG_ERR, "select error: %s", strerror(errno));
-      continue;
-    }
-
-    // accept a new connection
-    if (FD_ISSET(sk_listen, &read_fd_set)) {
-      if ((sk_temp = accept(sk_listen, NULL, NULL)) >= 0) {
-        create_client(sk_temp);
-      } else {
-        syslog(LOG_ERR, "accept error: %s", strerror(errno));
-      }
-    }
-
-    // receive commands from clients
-    this_ptr = first_client_ptr;
-    while (this_ptr) {
-      next_ptr = this_ptr->next_ptr;
-      if (FD_ISSET(this_ptr->sk, &read_fd_set)) {
-        receive_packet(this_ptr);
-      }
-      this_ptr = next_ptr;
-    }
-
+  // start sending threads
+  if (threads) {
+    start_workers(threads);
   }
 
+  // the main loop
+#ifdef XBUS_URING
+  run_uring(sk_listen);
+#else
+  run_epoll(sk_listen);
+#endif
+
   // terminate the program
   return EXIT_SUCCESS;
 }
@@ -19,8 +19,8 @@
 #include "xbus.h"
 
 // **************************************************************************
-// concatenate the program arguments into one string
-static const char *concat_argv(int argc, char **argv, int from)
+// concatenate the program arguments into one string with the separator of one character
+static const char *concat_argv(int argc, char **argv, int from, const char *separator)
 {
   char                  *payload;
   int                   len;
@@ -43,7 +43,7 @@ static const char *concat_argv(int argc, char **argv, int from)
   payload[0] = '\0';
   for (i = from; i < argc; i++) {
     if (i > from) {
-      strcat(payload, "\n");
+      strcat(payload, separator);
     }
     strcat(payload, argv[i]);
   }
@@ -58,6 +58,7 @@ int main(int argc, char **argv)
 {
   char                  *topic;
   char                  *payload;
+  unsigned long         id;
 
   // process the command
   if (argc > 1) {
@@ -75,27 +76,34 @@ int main(int argc, char **argv)
       // command "publish"
       case 'p':
         if (argc > 3) {
-          xbus_publish(argv[2], concat_argv(argc, argv, 3));
+          xbus_publish(argv[2], concat_argv(argc, argv, 3, "\n"));
           return EXIT_SUCCESS;
         }
         break;
       // command "write"
       case 'w':
         if (argc > 3) {
-          xbus_write(argv[2], concat_argv(argc, argv, 3));
+          xbus_write(argv[2], concat_argv(argc, argv, 3, "\n"));
           return EXIT_SUCCESS;
         }
         break;
       // command "read"
       case 'r':
-        if (argc > 2) {
+        if (argc == 3 && !strpbrk(argv[2], "+*")) {
           printf("%s\n", xbus_read(argv[2]));
           return EXIT_SUCCESS;
         }
+        if (argc > 2) {
+          id = xbus_request_bulk(concat_argv(argc, argv, 2, "\n"));
+          while ((payload = xbus_wait_bulk(id, &topic, NULL))) {
+            printf("[%s]\n%s\n\n", topic, payload);
+          }
+          return EXIT_SUCCESS;
+        }
         break;
       // command "list"
       case 'l':
-        printf("%s", xbus_list());
+        printf("%s", xbus_list_options(argc > 2 ? argv[2] : "*", argc > 3 ? concat_argv(argc, argv, 3, " ") : ""));
         return EXIT_SUCCESS;
     }
   }
@@ -107,8 +115,8 @@ int main(int argc, char **argv)
          "  subscribe <topic>\n"
          "  publish <topic> <payload>\n"
          "  write <topic> <payload>\n"
-         "  read <topic>\n"
-         "  list\n",
+         "  read <topic> [<topic>...]\n"
+         "  list [<topic> [<option>...]]\n",
          basename(argv[0]));
 
   // terminate the program